@@ -0,0 +1,173 @@
+// Crawls a generated blog-like site with every crawl policy on the same page
+// budget and reports the yield of article pages, i.e. how much of the budget
+// reached the pages worth having rather than tag archives and pagination.
+// No network is involved: links come from the URL alone.
+//
+//   frontier_bench [BUDGET] [ARTICLES]
+#include "frontier.h"
+#include "url_scorer.h"
+#include "url_view.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+const std::string kSite = "http://site.test";
+const std::string kTarget = "/article/";
+constexpr int kTags = 30;
+constexpr int kTagPages = 40;
+constexpr int kPerListing = 10;
+constexpr int kCommentPages = 5;
+
+uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// The home page paginates over all articles, newest first; every tag has
+// kTagPages archive pages with a tag cloud; articles link to related
+// articles, their tags, their comment pages and home.
+std::vector<std::string> linksOf(const std::string& url, uint64_t articles) {
+    UrlView view(url);
+    std::string path(view.path());
+    std::string query(view.query());
+    uint64_t page = query.compare(0, 5, "page=") == 0 ? std::strtoull(query.c_str() + 5, nullptr, 10) : 1;
+
+    std::vector<std::string> links;
+    auto article = [&](uint64_t id) { links.push_back(kSite + "/article/" + std::to_string(id % articles)); };
+    auto tag = [&](uint64_t id, uint64_t tag_page) {
+        std::string link = kSite + "/tag/t" + std::to_string(id % kTags);
+        if (tag_page > 1) link += "?page=" + std::to_string(tag_page);
+        links.push_back(link);
+    };
+
+    if (path == "/") {
+        for (int t = 0; t < kTags; ++t) tag(t, 1);
+        for (int i = 0; i < kPerListing; ++i) article((page - 1) * kPerListing + i);
+        if (page * kPerListing < articles) links.push_back(kSite + "/?page=" + std::to_string(page + 1));
+    } else if (path.compare(0, 6, "/tag/t") == 0) {
+        uint64_t id = std::strtoull(path.c_str() + 6, nullptr, 10);
+        for (int t = 0; t < kTags; ++t) tag(t, 1);
+        for (int i = 0; i < kPerListing; ++i) article(mix(id * 100000 + page * kPerListing + i));
+        if (page < kTagPages) tag(id, page + 1);
+    } else if (path.compare(0, kTarget.size(), kTarget) == 0) {
+        uint64_t id = std::strtoull(path.c_str() + kTarget.size(), nullptr, 10);
+        for (int i = 0; i < 3; ++i) article(mix(id * 7 + i));
+        for (int i = 0; i < 3; ++i) tag(mix(id + i), 1);
+        for (int i = 1; i <= kCommentPages; ++i) {
+            links.push_back(kSite + "/comments/" + std::to_string(id) + "?page=" + std::to_string(i));
+        }
+        links.push_back(kSite + "/");
+    } else if (path.compare(0, 10, "/comments/") == 0) {
+        uint64_t id = std::strtoull(path.c_str() + 10, nullptr, 10);
+        links.push_back(kSite + "/article/" + std::to_string(id));
+        for (int i = 0; i < 3; ++i) tag(mix(id + i), 1);
+    }
+    return links;
+}
+
+struct Result {
+    double yield_quarter = 0, yield_half = 0, yield_all = 0;
+    double frontier_us = 0;     // Frontier and scorer time per page
+    size_t queued = 0;          // Left in the frontier at the end
+};
+
+Result crawl(UrlScorer::Policy policy, const UrlScorer::Weights& weights, int budget, uint64_t articles) {
+    UrlScorer scorer(policy, weights);
+    Frontier frontier;
+    if (policy == UrlScorer::Policy::BestFirst) {
+        frontier.setScorer([&scorer](const std::string& url, int depth) { return scorer.score(url, depth); },
+                           scorer.dynamic());
+    }
+
+    std::unordered_set<std::string> visited{kSite + "/"};
+    frontier.push(kSite + "/");
+    std::vector<int> hits;
+    std::chrono::nanoseconds frontier_time{0};
+
+    int pages = 0;
+    std::string url;
+    while (pages < budget) {
+        auto start = std::chrono::steady_clock::now();
+        if (!frontier.tryPop(url)) break;
+        int depth = frontier.depthOf(url);
+        frontier_time += std::chrono::steady_clock::now() - start;
+
+        pages++;
+        if (url.compare(kSite.size(), kTarget.size(), kTarget) == 0) hits.push_back(pages);
+
+        std::vector<std::string> links = linksOf(url, articles);
+        std::vector<std::string> fresh;
+        for (const auto& link : links) {
+            if (visited.insert(link).second) fresh.push_back(link);
+        }
+
+        start = std::chrono::steady_clock::now();
+        scorer.countInlinks(links);
+        frontier.pushBatch(std::move(fresh), depth + 1);
+        frontier.release(url);
+        frontier.complete(url);
+        frontier_time += std::chrono::steady_clock::now() - start;
+    }
+
+    auto yield = [&](int first) {
+        size_t count = std::count_if(hits.begin(), hits.end(), [first](int n) { return n <= first; });
+        return first > 0 ? count * 100.0 / first : 0.0;
+    };
+    Result result;
+    result.yield_quarter = yield(pages / 4);
+    result.yield_half = yield(pages / 2);
+    result.yield_all = yield(pages);
+    result.frontier_us = pages ? std::chrono::duration<double, std::micro>(frontier_time).count() / pages : 0;
+    result.queued = frontier.size();
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int budget = argc > 1 ? std::max(1, std::atoi(argv[1])) : 1000;
+    uint64_t articles = argc > 2 ? std::max(1ull, std::strtoull(argv[2], nullptr, 10)) : 5000;
+
+    struct Policy {
+        const char* name;
+        UrlScorer::Policy policy;
+        double depth, inlinks;
+        const char* url_weights;
+    };
+    const Policy policies[] = {
+        {"bfs", UrlScorer::Policy::Bfs, 0, 0, ""},
+        {"best-first: depth", UrlScorer::Policy::BestFirst, 1, 0, ""},
+        {"best-first: depth, inlinks", UrlScorer::Policy::BestFirst, 1, 1, ""},
+        {"best-first: weights", UrlScorer::Policy::BestFirst, 0, 0, "/article/=3,/tag/=-2,/comments/=-3,*page=*=-2"},
+        {"best-first: weights, depth, inlinks", UrlScorer::Policy::BestFirst, 1, 1,
+         "/article/=3,/tag/=-2,/comments/=-3,*page=*=-2"},
+    };
+
+    std::cout << articles << " articles, " << kTags << " tags with " << kTagPages << " archive pages each, budget "
+              << budget << " pages, target '" << kTarget << "'" << std::endl;
+    std::cout << std::left << std::setw(38) << "policy" << std::right << std::setw(10) << "quarter"
+              << std::setw(10) << "half" << std::setw(10) << "all" << std::setw(12) << "us/page"
+              << std::setw(10) << "queued" << std::endl;
+    std::cout << std::fixed;
+    for (const auto& policy : policies) {
+        UrlScorer::Weights weights;
+        weights.depth = policy.depth;
+        weights.inlinks = policy.inlinks;
+        UrlScorer::weightsFromSpec(policy.url_weights, weights);
+        Result result = crawl(policy.policy, weights, budget, articles);
+        std::cout << std::left << std::setw(38) << policy.name << std::right << std::setprecision(1)
+                  << std::setw(9) << result.yield_quarter << "%" << std::setw(9) << result.yield_half << "%"
+                  << std::setw(9) << result.yield_all << "%" << std::setprecision(2) << std::setw(12)
+                  << result.frontier_us << std::setw(10) << result.queued << std::endl;
+    }
+    return 0;
+}
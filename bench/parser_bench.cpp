@@ -0,0 +1,90 @@
+// Compares the streaming tokenizer and the Gumbo link extractors on a
+// directory of saved pages, e.g. the output of a crawl.
+//
+//   parser_bench DIR [ITERATIONS] [BASE_URL]
+#include "parser.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchResult {
+    double seconds = 0;
+    size_t links = 0;
+};
+
+BenchResult run(const std::vector<std::string>& pages, const std::string& base_url,
+                LinkParser::Engine engine, int iterations) {
+    BenchResult result;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        for (const auto& page : pages) {
+            result.links += LinkParser::extractLinks(page, base_url, base_url, engine).size();
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void report(const std::string& name, const BenchResult& result, size_t bytes, size_t pages, int iterations) {
+    double mb = static_cast<double>(bytes) * iterations / (1024.0 * 1024.0);
+    std::cout << name << ": " << result.seconds * 1000.0 << " ms, "
+              << mb / result.seconds << " MB/s, "
+              << pages * iterations / result.seconds << " pages/s, "
+              << result.links / iterations << " links per pass" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " DIR [ITERATIONS] [BASE_URL]" << std::endl;
+        return 1;
+    }
+    std::string dir = argv[1];
+    int iterations = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+    // Empty base keeps every absolute http(s) link, so both engines are compared on all of them
+    std::string base_url = argc > 3 ? argv[3] : "";
+
+    std::vector<std::string> pages;
+    size_t bytes = 0;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (!entry.is_regular_file() || entry.path().extension() != ".html") continue;
+        std::ifstream in(entry.path(), std::ios::binary);
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        pages.push_back(buffer.str());
+        bytes += pages.back().size();
+    }
+    if (pages.empty()) {
+        std::cerr << "No .html files found in " << dir << std::endl;
+        return 1;
+    }
+
+    std::cout << pages.size() << " pages, " << bytes / 1024 << " KB, " << iterations << " iterations" << std::endl;
+
+    // Pages where the two engines disagree on the set of links
+    size_t mismatches = 0;
+    for (const auto& page : pages) {
+        auto a = LinkParser::extractLinks(page, base_url, base_url, LinkParser::Engine::Tokenizer);
+        auto b = LinkParser::extractLinks(page, base_url, base_url, LinkParser::Engine::Gumbo);
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        if (a != b) mismatches++;
+    }
+
+    BenchResult gumbo = run(pages, base_url, LinkParser::Engine::Gumbo, iterations);
+    BenchResult tokenizer = run(pages, base_url, LinkParser::Engine::Tokenizer, iterations);
+    report("gumbo    ", gumbo, bytes, pages.size(), iterations);
+    report("tokenizer", tokenizer, bytes, pages.size(), iterations);
+    std::cout << "Speedup: " << gumbo.seconds / tokenizer.seconds << "x, "
+              << mismatches << " pages with differing link sets" << std::endl;
+    return 0;
+}
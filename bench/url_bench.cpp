@@ -0,0 +1,143 @@
+// Compares UrlView-based URL helpers with the std::regex versions they
+// replaced, on generated URLs or a file of URLs (one per line).
+//
+//   url_bench [ITERATIONS] [URL_FILE]
+#include "url_view.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<uint64_t> allocations{0};
+volatile size_t result_sink = 0;   // Keeps the measured calls from being optimized away
+
+// The helpers as they were before UrlView
+std::string regexBaseDomain(const std::string& url) {
+    std::smatch match;
+    std::regex domain_regex(R"(^(https?:\/\/[^\/]+))");
+    if (std::regex_search(url, match, domain_regex)) {
+        return match[1];
+    }
+    return "";
+}
+
+std::string regexSafeFilename(const std::string& url) {
+    return std::regex_replace(url, std::regex("[:/]+"), "_");
+}
+
+bool findIsHttp(const std::string& url) {
+    return url.find("http://") == 0 || url.find("https://") == 0;
+}
+
+std::vector<std::string> generateUrls(size_t count) {
+    const char* paths[] = {"/", "/index.html", "/wiki/Special:Random", "/a/b/c/d.html",
+                           "/search?q=web+crawler&page=2", "/docs/v1/api#section-3"};
+    std::vector<std::string> urls;
+    urls.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string url = (i % 3 == 0) ? "https://" : "http://";
+        url += "host" + std::to_string(i % 97) + ".example.org";
+        if (i % 11 == 0) url += ":8080";
+        url += paths[i % (sizeof(paths) / sizeof(paths[0]))];
+        if (i % 5 == 0) url += (url.find('?') == std::string::npos ? "?id=" : "&id=") + std::to_string(i);
+        urls.push_back(std::move(url));
+    }
+    return urls;
+}
+
+template <typename Fn>
+void measure(const char* name, const std::vector<std::string>& urls, int iterations, Fn fn) {
+    size_t sink = 0;
+    uint64_t allocations_before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        for (const auto& url : urls) sink += fn(url);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double calls = static_cast<double>(urls.size()) * iterations;
+    std::cout << name << ": " << seconds * 1e9 / calls << " ns/call, "
+              << (allocations.load() - allocations_before) / calls << " allocations/call" << std::endl;
+    result_sink = sink;
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 20;
+    std::vector<std::string> urls;
+    if (argc > 2) {
+        std::ifstream in(argv[2]);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty()) urls.push_back(line);
+        }
+    } else {
+        urls = generateUrls(10000);
+    }
+    if (urls.empty()) {
+        std::cerr << "No URLs to measure" << std::endl;
+        return 1;
+    }
+
+    // Both versions must agree before their speed means anything
+    size_t mismatches = 0;
+    for (const auto& url : urls) {
+        if (regexBaseDomain(url) != Utils::extractBaseDomain(url) ||
+            regexSafeFilename(url) != Utils::createSafeFilename(url) ||
+            findIsHttp(url) != UrlView(url).isHttp()) {
+            mismatches++;
+        }
+    }
+    std::cout << urls.size() << " URLs, " << iterations << " iterations, "
+              << mismatches << " URLs with differing results" << std::endl;
+
+    measure("base domain, regex      ", urls, iterations, [](const std::string& url) {
+        return regexBaseDomain(url).size();
+    });
+    measure("base domain, Utils      ", urls, iterations, [](const std::string& url) {
+        return Utils::extractBaseDomain(url).size();
+    });
+    measure("base domain, UrlView    ", urls, iterations, [](const std::string& url) {
+        return UrlView(url).origin().size();
+    });
+    measure("safe filename, regex    ", urls, iterations, [](const std::string& url) {
+        return regexSafeFilename(url).size();
+    });
+    measure("safe filename, Utils    ", urls, iterations, [](const std::string& url) {
+        return Utils::createSafeFilename(url).size();
+    });
+    measure("http check, find        ", urls, iterations, [](const std::string& url) {
+        return static_cast<size_t>(findIsHttp(url));
+    });
+    measure("http check, UrlView     ", urls, iterations, [](const std::string& url) {
+        return static_cast<size_t>(UrlView(url).isHttp());
+    });
+    measure("all components, UrlView ", urls, iterations, [](const std::string& url) {
+        UrlView view(url);
+        return view.host().size() + view.port().size() + view.path().size() + view.query().size();
+    });
+    return 0;
+}
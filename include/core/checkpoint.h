@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include "spill_queue.h"
+#include "visited_store.h"
+
+// Point-in-time copy of the crawler state needed to resume a crawl
+struct CrawlCheckpoint {
+    std::string start_url;
+    int downloaded_count = 0;
+    std::unique_ptr<VisitedStore> visited;
+    std::vector<std::string> frontier_urls;     // Includes fetches that were still in progress
+    SpillQueue::State spill;
+};
+
+// Reads and writes checkpoints under <output>/.checkpoint. A new checkpoint is
+// written to a temporary directory and swapped in with renames, so a crash
+// while writing leaves the previous checkpoint intact.
+class Checkpoint {
+public:
+    static std::string directory(const std::string& output_dir);
+    static bool exists(const std::string& output_dir);
+
+    static bool write(const std::string& output_dir, const CrawlCheckpoint& checkpoint);
+    static bool read(const std::string& output_dir, CrawlCheckpoint& checkpoint);
+    static bool readStartUrl(const std::string& output_dir, std::string& start_url);
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <fstream>
+#include "downloader.h"
+
+// Finds how many parallel fetches each host takes, the way TCP finds a
+// congestion window. Every fetch is reported when it starts and when it
+// ends. Once a host has completed a window of fetches (as many as its limit,
+// roughly one round trip of the host's parallel fetches), its limit is
+// reconsidered:
+//   - a 429 or 503 (throttled), 10% of fetches failing with another 5xx or a
+//     network error (errors), or an average latency above twice the host's
+//     recent best (latency) halves the limit;
+//   - a clean window in which the host used its whole limit raises it by
+//     one, or doubles it until the first decrease (slow start);
+//   - otherwise the limit holds.
+// Limits stay within the global bounds, and fetches started before a
+// decrease are left out of the next window, since they ran under the old
+// limit. Changed limits are handed to a callback, normally the frontier's.
+//
+// Every decision, holds included, is appended to a CSV log with the window's
+// fetch count, average latency, throughput and error rate.
+class ConcurrencyController {
+public:
+    // Called with the controller's lock held, so limits arrive in order
+    using LimitCallback = std::function<void(const std::string& host, int limit)>;
+
+    struct Stats {
+        uint64_t decisions = 0;
+        uint64_t increases = 0;
+        uint64_t throttled = 0;     // Decreases by reason
+        uint64_t errors = 0;
+        uint64_t latency = 0;
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct HostState {
+        int limit = 0;
+        bool slow_start = true;
+        std::unordered_map<std::string, Clock::time_point> started;     // URLs in flight
+        int peak = 0;                   // Most fetches in flight during the window
+        Clock::time_point window_start;
+        Clock::time_point last_decrease{};
+        size_t fetches = 0;             // Counted in the window
+        size_t throttled = 0;           // 429 and 503
+        size_t failures = 0;            // Other 5xx and network errors
+        uint64_t latency_us = 0;
+        uint64_t bytes = 0;
+        std::deque<uint64_t> recent;    // Average latency of the last windows
+    };
+
+    int min_limit;
+    int max_limit;
+    LimitCallback on_limit;
+    std::string log_path;
+    std::ofstream log;
+    Clock::time_point start_time;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, HostState> hosts;   // By Frontier::hostKey()
+    Stats stats;
+
+    HostState& stateFor(const std::string& host);
+    void decide(const std::string& host, HostState& state, Clock::time_point now);
+    void writeLog(const std::string& host, int previous, int limit, const char* reason, const HostState& state,
+                  uint64_t average_us, double seconds);
+
+public:
+    // log_path is created on the first decision and appended to
+    ConcurrencyController(int min_limit, int max_limit, const std::string& log_path, LimitCallback on_limit);
+    ConcurrencyController(const ConcurrencyController&) = delete;
+    ConcurrencyController& operator=(const ConcurrencyController&) = delete;
+
+    // Limit of a host no decision has been made for
+    int initialLimit() const { return min_limit; }
+
+    // Report every fetch that started, and its result once it has ended
+    void started(const std::string& url);
+    void finished(const DownloadResult& result);
+
+    Stats getStats() const;
+    void printStats() const;
+};
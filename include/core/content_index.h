@@ -0,0 +1,77 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+// Content-addressed bookkeeping for the page store. Every stored body is
+// identified by its SHA-1 digest, written the way WARC writes payload
+// digests ("sha1:" and 32 base32 characters). The index remembers where each
+// digest was first stored, so an identical body is stored as a reference to
+// that copy instead of a second time.
+//
+// The URL to digest map is kept in <output>/content.map with one line per
+// stored page:
+//   + DIGEST DATE URL     the body was stored for URL, fetched at DATE
+//   = DIGEST DATE URL     URL has the same body as an earlier page
+// A later line for a URL replaces the earlier ones. Writers reload the map,
+// so bodies stored by earlier runs are not stored again.
+//
+// When bodies can be overwritten (one file per URL), a stored body moves to
+// another URL sharing it before its URL gets a different body; the move is
+// recorded as a new "+" line.
+class ContentIndex {
+public:
+    struct Original {
+        std::string url;            // Page the body is stored for
+        std::string fetch_time;
+    };
+
+private:
+    std::string directory;
+    bool overwrites;
+    std::unordered_map<std::string, Original> originals;    // Digest -> stored copy
+    std::unordered_map<std::string, std::string> digests;   // URL -> digest, kept only when overwrites
+    int map_fd = -1;
+    std::string buffer;             // Lines not yet written to the map
+    std::vector<std::string> unflushed;     // Digests first stored since the last flush
+
+    void append(char kind, const std::string& digest, const std::string& fetch_time, const std::string& url);
+
+public:
+    ContentIndex(const std::string& directory, bool overwrites);
+    ~ContentIndex();
+    ContentIndex(const ContentIndex&) = delete;
+    ContentIndex& operator=(const ContentIndex&) = delete;
+
+    // Reads the map left by earlier runs; returns false if there is none
+    bool load();
+
+    // The stored copy of a body, or nullptr if none was stored yet
+    const Original* find(const std::string& digest) const;
+    // Digest of the latest body recorded for url, empty if unknown or not kept
+    std::string digestOf(const std::string& url) const;
+    // Records that url has the body with digest. The first URL recorded for a
+    // digest stores it; returns false if the body was stored before.
+    bool record(const std::string& url, const std::string& fetch_time, const std::string& digest);
+    // Hands the body stored for url to another URL sharing it and returns
+    // that URL. Returns an empty string if none shares it; the body is then
+    // forgotten.
+    std::string transfer(const std::string& url, const std::string& digest);
+
+    // Appends the recorded lines to the map, fsyncing it if sync is set.
+    // Nothing reaches the map before, so the caller flushes it only once the
+    // pages recorded are written.
+    bool flush(bool sync = false);
+    // Forgets what was recorded since the last flush, for pages whose writes
+    // were lost. Meant for append-only storage: transfers are not undone.
+    void discard();
+
+    size_t uniqueBodies() const { return originals.size(); }
+
+    // "sha1:" followed by the base32 SHA-1 of data
+    static std::string digest(const std::string& data);
+    static std::string mapPath(const std::string& directory);
+    // Latest digest of every URL in a map
+    static bool readMap(const std::string& path, std::unordered_map<std::string, std::string>& url_digests);
+};
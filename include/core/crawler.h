@@ -1,32 +1,121 @@
 #pragma once
 #include <string>
-#include <queue>
-#include <unordered_set>
-#include <queue>
-#include <unordered_set>
 #include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "thread_pool.h"
+#include "frontier.h"
+#include "visited_store.h"
+#include "parser.h"
+#include "url_canonicalizer.h"
+#include "page_writer.h"
+#include "downloader.h"
+#include "recrawl_cache.h"
+#include "robots.h"
+#include "url_scorer.h"
+#include "simhash.h"
+#include "dns_resolver.h"
+#include "concurrency_controller.h"
+#include "retry_queue.h"
 
 struct CrawlOptions {
     int max_pages = -1;  // -1 means no limit
     std::string output_dir = "output";
     int concurrent_threads = 5;     // Number of concurrent downloads
+    int max_in_flight = 0;          // >0 uses the event-driven engine with this many transfers in flight
+    int host_delay_ms = 0;          // Minimum delay between fetches to the same host
+    int max_per_host = 0;           // Max parallel fetches per host, 0 means unlimited
+    bool adaptive_concurrency = false;  // Adjust each host's parallel fetches to its latency and errors
+    int min_per_host = 1;           // Lower bound of the adaptive limits
+    int max_retries = 3;            // Fetches of a URL after a transient failure, 0 disables retries
+    int retry_delay_ms = 1000;      // Backoff before the first retry, doubled for each one after
+    int retry_max_delay_sec = 300;  // Cap on the backoff; a longer Retry-After gives the URL up
+    size_t frontier_memory_mb = 0;  // In-memory frontier cap before spilling to disk, 0 means unlimited
+    std::string visited_store = "fingerprint";  // "fingerprint" or "bloom"
+    double bloom_fp_rate = 0.001;   // False-positive bound for the bloom visited store
+    int checkpoint_interval_sec = 60;   // Periodic checkpoint to <output_dir>/.checkpoint, 0 disables
+    bool resume = false;            // Restore frontier, visited set and counters from the checkpoint
+    std::string link_parser = "tokenizer";  // "tokenizer" or "gumbo"
+    std::string storage_format = "segments";   // "segments" (WARC) or "files" (one .html per page)
+    size_t segment_size_mb = 256;   // Segment roll-over size
+    size_t write_queue_mb = 64;     // Pages buffered for the storage thread before workers block
+    std::string fsync_policy = "none";  // "none", "batch" or "interval"
+    int fsync_interval_ms = 1000;   // Used by the "interval" fsync policy
+    std::string compression = "none";   // "none" or "zlib" (per page)
+    size_t dictionary_samples = 0;  // Pages sampled to train a compression dictionary, 0 for none
+    bool store_duplicates = false;  // Store identical bodies again instead of referring to the first copy
+    bool incremental = false;       // Recrawl the pages of earlier runs with conditional requests
+    bool html_only = true;          // Abort responses whose Content-Type is not HTML
+    size_t max_page_kb = 10240;     // Abort responses larger than this, 0 means no limit
+    std::string url_rules = "drop-tracking,sort-query";  // Canonicalization rules, or "none"
+    std::string drop_params;        // Comma-separated query parameters to drop as well
+    bool respect_robots = true;     // Skip URLs disallowed by robots.txt and honor its Crawl-delay
+    int robots_ttl_sec = 86400;     // How long a fetched robots.txt is used before it is fetched again
+    std::vector<std::string> sitemaps;  // Sitemaps to seed the frontier from; "auto" looks them up
+    std::string crawl_policy = "bfs";   // "bfs" or "best-first"
+    std::string url_weights;        // Best-first pattern weights, "PATTERN=WEIGHT,..."
+    double depth_weight = 1.0;      // Best-first score lost per link from a seed
+    double inlink_weight = 1.0;     // Best-first score per doubling of the links to a URL
+    std::string scorer_plugin;      // Shared library exporting scoreUrl, added to best-first scores
+    std::string target_pattern;     // Pages matching it are counted in the yield report
+    bool skip_near_dups = false;    // Neither store nor expand pages whose text nearly matches a recent page
+    int near_dup_bits = 3;          // Largest SimHash distance that counts as a near-duplicate
+    size_t near_dup_window = 100000;    // Recent fingerprints compared against
+    bool dns_prefetch = false;      // Resolve hosts while their URLs wait in the frontier
+    std::string dns_hosts;          // Hosts file pinning addresses, implies dns_prefetch
+    int dns_ttl_sec = 300;          // How long a prefetched address is used
 };
 
 class WebCrawler {
 private:
     std::string start_url;
     std::string base_domain;
-    std::queue<std::string> url_queue;
-    std::unordered_set<std::string> visited;
+    std::unique_ptr<Frontier> frontier;
+    std::unique_ptr<ShardedVisitedStore> visited;
     CrawlOptions options;
+    LinkParser::Engine link_engine = LinkParser::Engine::Tokenizer;
+    UrlCanonicalizer canonicalizer;
+    std::unique_ptr<ShardedVisitedStore> aliases;   // Non-canonical spellings seen, for the summary
+    UrlScorer scorer;
+    DownloadLimits download_limits;
     std::unique_ptr<ThreadPool> thread_pool;
+    std::unique_ptr<PageWriter> page_writer;
+    std::unique_ptr<RecrawlCache> recrawl_cache;    // Incremental recrawls only
+    std::unique_ptr<RobotsCache> robots;            // Unless robots.txt is ignored
+    std::unique_ptr<NearDuplicateIndex> near_dups;  // With skip_near_dups only
+    std::unique_ptr<DnsResolver> resolver;          // With dns_prefetch only
+    std::unique_ptr<ConcurrencyController> concurrency;     // With adaptive_concurrency only
+    std::unique_ptr<RetryQueue> retries;            // Unless max_retries is 0
+    bool resumed = false;
+
+    mutable std::mutex target_mutex;
+    std::vector<int> target_hits;   // Page numbers of the pages matching target_pattern
+    int pages_before = 0;           // Crawled by the runs a resumed crawl continues
+
+    std::thread checkpoint_thread;
+    std::mutex checkpoint_mutex;
+    std::condition_variable checkpoint_cv;
+    bool checkpoint_stop = false;
 
-    bool tryPopUrl(std::string& url);
     void workerFunction();
+    void crawlEventDriven();
+    bool processPage(DownloadResult&& page);
+    bool checkUnchanged(const DownloadResult& page);
+    bool isNearDuplicate(const DownloadResult& page);
+    void countAliases(const std::vector<std::string>& links, const std::vector<std::string>& resolved,
+                      const std::vector<std::string>& fresh);
+    void printSummary() const;
+    void seedFromSitemaps();
+
+    bool loadCheckpoint();
+    bool writeCheckpoint();
+    void checkpointLoop();
     
 public:
     WebCrawler(const std::string& start_url, const CrawlOptions& opts = CrawlOptions());
+    ~WebCrawler();
     void crawl();
     std::string getBaseDomain() const {return base_domain;}
 };
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <curl/curl.h>
+
+// Resolves hosts ahead of the transfers that need them. URLs entering the
+// frontier are handed to prefetch(), and resolver threads look their hosts
+// up with getaddrinfo while the URLs wait their turn. A transfer then gets
+// the cached addresses as CURLOPT_RESOLVE entries, so curl connects without
+// resolving.
+//
+// Entries live for the TTL. An entry used in the last quarter of its TTL is
+// refreshed in the background, and an expired one is still served while its
+// refresh runs, so a busy host never makes a transfer wait on DNS again.
+//
+// Hosts from a hosts file ("ADDRESS NAME [ALIAS...]") are never resolved
+// or refreshed, which pins hosts for tests or staging servers.
+class DnsResolver {
+public:
+    struct Stats {
+        uint64_t lookups = 0;       // Transfers that asked for a host
+        uint64_t hits = 0;          // Served from the cache without waiting
+        uint64_t waits = 0;         // Waited for a prefetch already in flight
+        uint64_t misses = 0;        // Resolved on demand, or left to curl
+        uint64_t resolutions = 0;   // getaddrinfo calls made
+        uint64_t refreshes = 0;     // Of them, background refreshes of cached hosts
+        uint64_t failures = 0;
+        uint64_t resolve_us = 0;    // Total and longest getaddrinfo time
+        uint64_t max_resolve_us = 0;
+        uint64_t wait_us = 0;       // Time transfers spent waiting for the resolver
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string host;
+        std::string port;
+        std::string addresses;      // "ADDRESS,ADDRESS", IPv6 in brackets; empty if unresolved
+        Clock::time_point expires;
+        bool pending = false;       // A resolution is queued or running
+        bool queued = false;        // Waiting in the queue, not yet taken by a thread
+    };
+
+    std::chrono::seconds ttl;
+    mutable std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable resolved;
+    std::unordered_map<std::string, Entry> entries;     // "host:port" -> entry
+    std::unordered_map<std::string, std::string> pinned;    // Host -> addresses from the hosts file
+    std::deque<std::string> queue;                      // Keys waiting for a resolver thread
+    std::vector<std::thread> threads;
+    bool stopping = false;
+    Stats stats;
+
+    void resolverLoop();
+    // Runs getaddrinfo without the lock and stores the result
+    void resolve(const std::string& key, std::unique_lock<std::mutex>& lock);
+    void enqueue(const std::string& key, Entry& entry);
+    static curl_slist* entryList(const std::string& host, const std::string& port, const std::string& addresses);
+
+public:
+    explicit DnsResolver(size_t threads = 4, std::chrono::seconds ttl = std::chrono::seconds(300));
+    ~DnsResolver();
+    DnsResolver(const DnsResolver&) = delete;
+    DnsResolver& operator=(const DnsResolver&) = delete;
+
+    // Pins the hosts in a hosts file; returns false if it cannot be read
+    bool loadHostsFile(const std::string& path);
+
+    // Queues the hosts of urls that are neither cached nor being resolved
+    void prefetch(const std::vector<std::string>& urls);
+    // CURLOPT_RESOLVE entries for the host of url, or nullptr if it is not
+    // resolved yet (or is an IP literal). With wait, the caller blocks until
+    // a prefetch in flight finishes, or resolves the host itself; without,
+    // the host is queued and curl resolves it this time. The caller frees
+    // the list after the transfer.
+    curl_slist* lookup(const std::string& url, bool wait);
+
+    Stats getStats() const;
+    void printStats() const;
+};
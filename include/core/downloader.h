@@ -1,7 +1,107 @@
 #pragma once
 #include <string>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <curl/curl.h>
+
+class DnsResolver;
+
+// Why a transfer was cut off before its body was complete
+enum class AbortReason { None, ContentType, ContentLength, BodySize };
+
+struct DownloadResult {
+    std::string url;
+    std::string headers;    // Raw response headers of the final response, status line included
+    std::string body;
+    long status_code = 0;   // Also of aborted transfers, 0 if no response arrived
+    CURLcode error = CURLE_OK;
+    AbortReason abort_reason = AbortReason::None;   // Set with error CURLE_WRITE_ERROR
+    uint64_t body_bytes = 0;    // Decoded body bytes received, also when streamed to a sink
+    std::chrono::system_clock::time_point fetch_time;
+};
+
+// Responses the caller does not want are aborted as soon as that is known:
+// the type and declared length once the final response's headers are in,
+// the size while the body streams in. The defaults accept everything.
+struct DownloadLimits {
+    bool html_only = false;         // Abort responses with a non-HTML Content-Type
+    uint64_t max_body_bytes = 0;    // Abort larger responses (declared or decoded size), 0 for no limit
+};
+
+// Takes a streamed body chunk by chunk instead of DownloadResult::body.
+// Returning false aborts the transfer.
+using BodySink = std::function<bool(const char* data, size_t size)>;
+
+// State shared with the curl callbacks for one transfer
+struct TransferContext {
+    DownloadResult* result = nullptr;
+    DownloadLimits limits;
+    long response_code = 0;     // Of the response whose headers are being read
+    const BodySink* sink = nullptr;
+};
+
+// Cache validators from an earlier fetch of a URL. Sent as If-None-Match and
+// If-Modified-Since, so an unchanged page is answered with 304 and no body.
+struct Validators {
+    std::string etag;
+    std::string last_modified;
+    bool empty() const { return etag.empty() && last_modified.empty(); }
+};
+
+// Connection reuse and transfer size counters, aggregated over all downloads
+struct DownloadStats {
+    uint64_t handles_created = 0;     // Easy handles created by the pool
+    uint64_t new_connections = 0;     // Transfers that had to open a new connection
+    uint64_t reused_connections = 0;  // Transfers served by a kept-alive connection
+    uint64_t wire_bytes = 0;          // Response bodies as received, before content decoding
+    uint64_t decoded_bytes = 0;       // Response bodies after content decoding
+    uint64_t encoded_responses = 0;   // Responses that arrived content-encoded
+    uint64_t aborted_content_type = 0;    // Early aborts by reason
+    uint64_t aborted_content_length = 0;
+    uint64_t aborted_body_size = 0;
+};
 
 class Downloader {
+private:
+    static DownloadResult perform(const std::string& url, const Validators& validators,
+                                  const DownloadLimits& limits, const BodySink* sink);
+
 public:
     static std::string download(const std::string& url);
-};
\ No newline at end of file
+    // Blocking download that keeps the status, headers and fetch time
+    static DownloadResult fetch(const std::string& url, const Validators& validators = Validators(),
+                                const DownloadLimits& limits = DownloadLimits());
+    // Blocking download that hands the body to sink as it arrives, for
+    // bodies too large to hold in memory. The result's body stays empty.
+    static DownloadResult stream(const std::string& url, const BodySink& sink,
+                                 const DownloadLimits& limits = DownloadLimits());
+
+    // Applies the crawler's transfer options to an easy handle.
+    // Shared by the blocking path and MultiDownloader. Every encoding libcurl
+    // was built with (gzip, deflate, br, zstd) is offered; libcurl decodes
+    // the body as it streams in, so the write callback only sees decoded data.
+    // The context receives the body and headers and must outlive the transfer.
+    static void configureHandle(CURL* curl, TransferContext* context);
+    // Request headers for a conditional GET, or nullptr without validators.
+    // The caller sets them as CURLOPT_HTTPHEADER and frees them after the transfer.
+    static curl_slist* conditionalHeaders(const Validators& validators);
+    // Primes every transfer with the addresses cached by resolver; nullptr
+    // turns it off. The resolver must outlive the transfers started with it.
+    static void setResolver(DnsResolver* resolver);
+    // CURLOPT_RESOLVE entries for url, or nullptr without a resolver or a
+    // cached address. With wait, a blocking transfer waits for the resolver
+    // instead of resolving in curl. The caller sets them as CURLOPT_RESOLVE
+    // and frees them after the transfer.
+    static curl_slist* resolveEntries(const std::string& url, bool wait);
+    // Updates the connection reuse and size counters after a finished transfer
+    static void recordTransfer(CURL* curl, const DownloadResult& result);
+    static const char* abortReasonName(AbortReason reason);
+
+    static DownloadStats getStats();
+    static void printStats();
+
+    // Releases pooled handles and the shared DNS/TLS cache.
+    // Must be called before curl_global_cleanup().
+    static void cleanup();
+};
@@ -0,0 +1,197 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <queue>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include "spill_queue.h"
+
+// Crawl frontier keyed by host. Each host has its own priority queue, a
+// minimum delay between fetches and a cap on parallel fetches, global or set
+// for the host. Hosts that have work queued sit in a ready-heap ordered by
+// the time they may next be fetched, so tryPop() only ever hands out URLs
+// that are eligible right now.
+//
+// Hosts are striped over independently locked shards by hash, so workers
+// pushing links for different hosts do not serialize on one lock. All state
+// for a host lives in a single shard, which keeps politeness exact.
+//
+// A host's URLs are ordered by the score a Scorer gives them, highest first,
+// and in arrival order among equal scores; without a scorer the queue is
+// FIFO. Scores fall into bands one point wide. Each band keeps at most
+// kBandHeapCapacity URLs in a heap and queues the rest in arrival order, so
+// pushes and pops stay O(log capacity) however many URLs a band holds. The
+// order is exact between bands and best-first within a band's heap. With a
+// dynamic scorer (one counting inlinks), a band's heap is rescored every
+// kRescoreInterval pops, and URLs move up a band once their score rises.
+//
+// With a memory limit set, URLs beyond the limit are spilled to disk and
+// read back in batches once the in-memory part has drained below half.
+// Spilled URLs come back in arrival order and take their place by score.
+//
+// Idle workers block in waitPop() until a push, release or complete() may
+// have made work available. The crawl is finished once nothing is queued and
+// every popped URL has been completed.
+class Frontier {
+public:
+    using Clock = std::chrono::steady_clock;
+    // Priority of a URL found depth links away from a seed; higher goes first
+    using Scorer = std::function<double(const std::string& url, int depth)>;
+
+private:
+    struct Entry {
+        std::string url;
+        double score;
+        uint64_t seq;           // Arrival order, breaks ties between equal scores
+        int depth;
+    };
+    // Orders a max-heap: the higher score, then the earlier arrival, on top
+    struct Lower {
+        bool operator()(const Entry& a, const Entry& b) const {
+            return a.score < b.score || (a.score == b.score && a.seq > b.seq);
+        }
+    };
+    struct Band {
+        std::vector<Entry> heap;        // At most kBandHeapCapacity entries
+        std::deque<Entry> overflow;     // The rest, waiting in arrival order
+        size_t pops = 0;                // Since the last rescore
+    };
+
+    struct HostQueue {
+        std::map<int, Band> bands;      // Best band first
+        size_t count = 0;               // URLs queued over all bands
+        Clock::time_point next_allowed{};
+        std::chrono::milliseconds delay{0};     // Host's own delay, e.g. a robots.txt Crawl-delay
+        int active = 0;         // Fetches popped but not yet released
+        int limit = 0;          // Host's own cap on active fetches, 0 for max_per_host
+        bool in_heap = false;
+    };
+
+    struct ReadyEntry {
+        Clock::time_point ready_at;
+        std::string host;
+        bool operator>(const ReadyEntry& other) const { return ready_at > other.ready_at; }
+    };
+
+    struct Shard {
+        std::unordered_map<std::string, HostQueue> hosts;
+        std::unordered_map<std::string, int> in_progress;  // Popped, not yet complete()d, with their depth
+        std::priority_queue<ReadyEntry, std::vector<ReadyEntry>, std::greater<ReadyEntry>> ready;
+        mutable std::mutex mutex;
+    };
+
+    std::chrono::milliseconds min_delay;
+    int max_per_host;           // 0 means unlimited
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<size_t> next_shard{0};  // Where the next tryPop() starts looking
+    std::atomic<size_t> queued{0};      // URLs held in memory
+    Scorer scorer;
+    bool rescore = false;
+    std::atomic<uint64_t> next_seq{0};
+
+    size_t memory_limit;        // Bytes of queued URLs kept in memory, 0 means unlimited
+    std::atomic<size_t> memory_used{0};
+    std::string spill_dir;
+    std::unique_ptr<SpillQueue> spill;
+    std::atomic<bool> spill_pending{false};    // Spill holds URLs not yet read back
+    mutable std::mutex spill_mutex;            // Taken before any shard mutex
+
+    std::atomic<size_t> in_flight{0};      // Popped, not yet complete()d
+    std::atomic<uint64_t> generation{0};   // Bumped on every change a waiter may care about
+    std::atomic<int> waiters{0};
+    std::atomic<bool> closed{false};
+    std::mutex wait_mutex;
+    std::condition_variable work_available;
+
+    std::chrono::milliseconds delayFor(const HostQueue& hq) const { return std::max(min_delay, hq.delay); }
+    int limitFor(const HostQueue& hq) const { return hq.limit > 0 ? hq.limit : max_per_host; }
+    bool canSchedule(const HostQueue& hq) const {
+        return hq.count > 0 && !hq.in_heap && (limitFor(hq) <= 0 || hq.active < limitFor(hq));
+    }
+    static int bandOf(double score);
+    Shard& shardFor(const std::string& host) const;
+    void schedule(Shard& shard, const std::string& host, HostQueue& hq);
+    Entry makeEntry(std::string url, int depth);
+    // Callers hold the shard's mutex
+    void enqueue(Shard& shard, const std::string& host, Entry entry);
+    void place(HostQueue& hq, Entry entry);
+    Entry takeBest(HostQueue& hq);
+    void rescoreBand(HostQueue& hq, int band);
+    bool popFrom(Shard& shard, Clock::time_point now, std::string& url, Clock::time_point& next_ready);
+    void enqueueBatch(std::vector<Entry>& entries);
+    void pushEntries(std::vector<Entry> entries);
+    void refillFromDisk();
+    bool shouldSpill(size_t extra) const;
+    void notifyWaiters();
+
+    static size_t entryCost(const std::string& url) {
+        return url.size() + sizeof(Entry) + 16;
+    }
+
+public:
+    Frontier(std::chrono::milliseconds min_delay = std::chrono::milliseconds(0), int max_per_host = 0,
+             size_t memory_limit = 0, const std::string& spill_dir = "", size_t num_shards = 16);
+
+    static std::string hostKey(const std::string& url);
+    // Delay between fetches to host (a hostKey()) when longer than the global one
+    void setHostDelay(const std::string& host, std::chrono::milliseconds delay);
+    // Parallel fetches allowed to host in place of max_per_host, e.g. as
+    // adjusted by a ConcurrencyController; 0 goes back to max_per_host
+    void setHostLimit(const std::string& host, int limit);
+
+    // Must be set before the first push; rescore marks a scorer whose scores
+    // change over time
+    void setScorer(Scorer scorer, bool rescore);
+
+    // Seeds are at depth 0, the links of a page one deeper than the page
+    void push(const std::string& url, int depth = 0);
+    // Queues a batch of URLs found at the same depth, taking each shard lock once
+    void pushBatch(std::vector<std::string> urls, int depth = 0);
+
+    // Pops a URL whose host may be fetched now. When nothing is eligible,
+    // returns false and, if wait is given, stores the time until the next
+    // host becomes eligible (zero when the frontier has nothing schedulable).
+    bool tryPop(std::string& url, std::chrono::milliseconds* wait = nullptr);
+    // Blocks until a URL can be popped. Returns false once the frontier is
+    // finished or has been closed.
+    bool waitPop(std::string& url);
+    // Wakes every waiter and makes waitPop() return false from now on
+    void close();
+
+    // Must be called once a fetch handed out by tryPop() has completed
+    void release(const std::string& url);
+    // Called once a popped URL has been fully processed (stored and its links
+    // queued). Until then it is included in snapshots so a resume refetches it.
+    void complete(const std::string& url);
+    // Queues a popped, not yet completed URL again at its depth, e.g. for a
+    // retry. Until then it counts as in flight, so the crawl does not finish
+    // while it waits.
+    void requeue(const std::string& url);
+    // Depth of a URL popped and not yet completed, 0 if unknown
+    int depthOf(const std::string& url) const;
+
+    bool empty() const;
+    // Nothing queued and nothing in flight: no more links can appear
+    bool finished() const;
+    size_t inFlight() const { return in_flight.load(); }
+    size_t size() const;
+    size_t hostCount() const;
+    uint64_t spilledCount() const;
+    size_t memoryUsage() const;
+
+    // Checkpoint support. snapshot() copies the in-memory and in-progress URLs and records
+    // the on-disk spill position; retired_segments is passed back to
+    // releaseSpill() once the checkpoint has been written.
+    void snapshot(std::vector<std::string>& urls, SpillQueue::State& spill_state, size_t& retired_segments);
+    bool restore(const std::vector<std::string>& urls, const SpillQueue::State& spill_state);
+    void releaseSpill(size_t retired_segments);
+    void setRetainSpill(bool retain);
+};
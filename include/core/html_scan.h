@@ -0,0 +1,69 @@
+#pragma once
+#include <cstring>
+#include <string_view>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Byte-level helpers shared by the hand-written HTML scanners (LinkParser's
+// fast path and SimHash), so both read tag names and skip script and style
+// contents the same way. ASCII case only; defined here to stay inlinable in
+// their inner loops.
+class HtmlScan {
+public:
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+    }
+
+    static bool isAlpha(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    static char toLower(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+
+    // Case-insensitive comparison against a lowercase literal
+    static bool equalsLower(const char* p, size_t len, std::string_view literal) {
+        if (len != literal.size()) return false;
+        for (size_t i = 0; i < len; ++i) {
+            if (toLower(p[i]) != literal[i]) return false;
+        }
+        return true;
+    }
+
+    // End of the tag name starting at p, just after a '<'
+    static const char* tagNameEnd(const char* p, const char* end) {
+        while (p < end && !isSpace(*p) && *p != '>' && *p != '/') ++p;
+        return p;
+    }
+
+    // Next '<' at or after p, 16 bytes at a time where SSE2 is available
+    static const char* findTagOpen(const char* p, const char* end) {
+#if defined(__SSE2__)
+        const __m128i lt = _mm_set1_epi8('<');
+        while (end - p >= 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, lt));
+            if (mask) return p + __builtin_ctz(mask);
+            p += 16;
+        }
+#endif
+        const void* hit = std::memchr(p, '<', end - p);
+        return hit ? static_cast<const char*>(hit) : end;
+    }
+
+    // Script and style contents are raw text; markup inside them is not parsed.
+    // Returns the position of the closing tag's '<'.
+    static const char* skipRawText(const char* p, const char* end, std::string_view tag) {
+        while ((p = findTagOpen(p, end)) < end) {
+            const char* name = p + 2;
+            if (name + tag.size() <= end && p[1] == '/' && equalsLower(name, tag.size(), tag) &&
+                (name + tag.size() == end || !isAlpha(name[tag.size()]))) {
+                return p;
+            }
+            ++p;
+        }
+        return end;
+    }
+};
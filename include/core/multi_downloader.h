@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_set>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <curl/curl.h>
+#include "downloader.h"
+
+using DownloadCallback = std::function<void(DownloadResult&& result)>;
+
+// Event-driven download engine: a single thread drives every transfer through
+// curl_multi_socket_action and an epoll loop, so the number of requests in
+// flight is no longer tied to the number of threads.
+class MultiDownloader {
+private:
+    struct Transfer {
+        CURL* handle = nullptr;
+        DownloadResult result;
+        TransferContext context;
+        DownloadCallback callback;
+        Validators validators;
+        curl_slist* request_headers = nullptr;
+        curl_slist* resolve = nullptr;      // Addresses from the DNS resolver
+        ~Transfer() {
+            curl_slist_free_all(request_headers);
+            curl_slist_free_all(resolve);
+        }
+    };
+
+    CURLM* multi = nullptr;
+    int epoll_fd = -1;
+    int wake_fd = -1;           // eventfd used to interrupt epoll_wait
+    bool timer_armed = false;   // Set by the timer callback, loop thread only
+    std::chrono::steady_clock::time_point timer_deadline;
+    std::thread loop_thread;
+    std::atomic<bool> running{false};
+    std::atomic<size_t> in_flight{0};
+
+    std::mutex pending_mutex;
+    std::deque<Transfer*> pending;      // Submitted, not yet added to the multi handle
+    std::unordered_set<Transfer*> active;   // Added to the multi handle (loop thread only)
+    std::vector<CURL*> idle_handles;        // Loop thread only
+
+    void eventLoop();
+    void addPendingTransfers();
+    void checkCompleted();
+    void wake();
+
+    static int socketCallback(CURL* easy, curl_socket_t s, int what, void* userp, void* socketp);
+    static int timerCallback(CURLM* multi, long timeout_ms, void* userp);
+
+public:
+    explicit MultiDownloader(long max_connections = 0);
+    ~MultiDownloader();
+
+    void start();
+    void stop();
+
+    // Queues a transfer. The callback runs on the event loop thread and
+    // should hand heavy work off to another thread.
+    void submit(const std::string& url, DownloadCallback callback, const Validators& validators = Validators(),
+                const DownloadLimits& limits = DownloadLimits());
+    size_t inFlight() const { return in_flight.load(); }
+};
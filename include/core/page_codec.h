@@ -0,0 +1,73 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <zlib.h>
+
+// Per-page zlib compression for the page store.
+//
+// Small pages from one site share most of their markup, which a single
+// page cannot exploit. A dictionary trained from a sample of pages primes
+// the compressor with that shared markup. Dictionaries are saved next to the
+// pages as dict-XXXXXXXX.zdict, named by the id zlib writes into every
+// stream compressed with them, so a reader finds the right one on demand.
+//
+// Compression is used by the writer thread only; decompression may be
+// called from any number of threads.
+class PageCodec {
+public:
+    enum class Method { None, Zlib };
+    static bool methodFromName(const std::string& name, Method& method);
+
+    // Decompression counters
+    struct Stats {
+        uint64_t pages = 0;
+        uint64_t encoded_bytes = 0;
+        uint64_t decoded_bytes = 0;
+        uint64_t decode_us = 0;
+        uint64_t failures = 0;
+    };
+
+private:
+    std::string directory;
+    int level;
+    z_stream deflater{};
+    bool deflater_ready = false;
+    std::string dictionary;             // Used by compress()
+    uint32_t dictionary_id = 0;
+
+    mutable std::mutex dictionaries_mutex;
+    std::unordered_map<uint32_t, std::shared_ptr<const std::string>> dictionaries;
+
+    std::atomic<uint64_t> decoded_pages{0}, encoded_bytes{0}, decoded_bytes{0};
+    std::atomic<uint64_t> decode_us{0}, decode_failures{0};
+
+    std::shared_ptr<const std::string> loadDictionary(uint32_t id);
+
+public:
+    explicit PageCodec(const std::string& directory, int level = Z_DEFAULT_COMPRESSION);
+    ~PageCodec();
+    PageCodec(const PageCodec&) = delete;
+    PageCodec& operator=(const PageCodec&) = delete;
+
+    // Compresses data into a zlib stream using the current dictionary, if any
+    bool compress(const std::string& data, std::string& out);
+    bool decompress(const std::string& data, std::string& out);
+
+    // Trains a dictionary from sample pages, saves it and uses it for every
+    // following compress() call. Returns false if the samples share too
+    // little to be worth a dictionary.
+    bool useTrainedDictionary(const std::vector<std::string>& samples);
+    uint32_t dictionaryId() const { return dictionary_id; }
+    size_t dictionarySize() const { return dictionary.size(); }
+
+    // Builds a dictionary of at most max_size bytes from markup shared across samples
+    static std::string trainDictionary(const std::vector<std::string>& samples, size_t max_size = 32 * 1024);
+    static std::string dictionaryPath(const std::string& directory, uint32_t id);
+
+    Stats getStats() const;
+};
@@ -0,0 +1,109 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "segment_store.h"
+#include "page_codec.h"
+#include "content_index.h"
+
+struct PageWriterStats {
+    uint64_t pages = 0;
+    uint64_t bytes = 0;
+    uint64_t batches = 0;
+    uint64_t fsyncs = 0;
+    uint64_t failures = 0;
+    uint64_t stalls = 0;            // submit() calls that waited for queue space
+    uint64_t stall_ms = 0;
+    uint64_t segments = 0;          // Segment files opened (segment storage only)
+    uint64_t raw_bytes = 0;         // Compressed pages before and after compression
+    uint64_t stored_bytes = 0;
+    size_t dictionary_bytes = 0;    // Size of the trained dictionary in use
+    uint64_t duplicates = 0;        // Pages whose body was already stored
+    uint64_t duplicate_bytes = 0;   // Their body bytes, not stored again
+};
+
+// Write-behind page storage. Workers hand pages to submit() and carry on;
+// a single writer thread drains the queue in batches. The queue is bounded
+// in bytes, so when the disk falls behind submit() blocks until the writer
+// catches up instead of letting memory grow.
+//
+// Pages are appended to WARC segments ("segments") or written one .html file
+// per URL ("files").
+//
+// Fsync policy: "none" leaves flushing to the OS, "batch" makes every batch
+// durable before it is acknowledged, "interval" syncs at most once per fsync
+// interval.
+//
+// With zlib compression every page is compressed on the writer thread. If
+// dictionary_samples is set, the first that many pages are kept as a sample
+// and a shared dictionary is trained from them; every later page is
+// compressed against it. Files are then written as .html.z.
+//
+// With deduplication every body is stored once (see ContentIndex). A page
+// whose body is already stored becomes a WARC revisit record pointing at the
+// stored copy, or, with one file per URL, gets no file of its own.
+class PageWriter {
+public:
+    enum class Format { Segments, Files };
+    enum class FsyncPolicy { None, Batch, Interval };
+    static bool formatFromName(const std::string& name, Format& format);
+    static bool policyFromName(const std::string& name, FsyncPolicy& policy);
+
+private:
+    using Page = PageRecord;
+
+    std::string output_dir;
+    std::unique_ptr<PageCodec> codec;               // Writer thread only
+    std::unique_ptr<SegmentWriter> segment_writer;  // Writer thread only
+    std::unique_ptr<ContentIndex> content_index;    // Writer thread only
+    size_t dictionary_samples;
+    std::vector<std::string> samples;               // Writer thread only
+    size_t max_queue_bytes;
+    FsyncPolicy fsync_policy;
+    std::chrono::milliseconds fsync_interval;
+    std::chrono::steady_clock::time_point last_sync;
+
+    std::deque<Page> queue;
+    size_t pending_bytes = 0;       // Queued plus the batch being written
+    uint64_t submitted = 0;         // Sequence number of the last submitted page
+    uint64_t written = 0;           // Pages done (written or failed)
+    bool closing = false;
+    PageWriterStats stats;
+
+    mutable std::mutex mutex;
+    std::condition_variable work_ready;     // Writer waits for pages
+    std::condition_variable space_ready;    // Producers wait for space and flushes
+    std::thread writer_thread;
+
+    void writerLoop();
+    bool writeFile(const Page& page, bool sync, uint64_t& raw_bytes, uint64_t& stored_bytes);
+    bool referToStoredCopy(Page& page);
+    bool shareFile(const Page& page, const std::string& digest);
+    void collectSamples(const std::vector<Page>& batch);
+    uint64_t finishBatch(bool& stored);
+
+public:
+    PageWriter(const std::string& output_dir, Format format = Format::Segments,
+               uint64_t segment_bytes = 256ull * 1024 * 1024, size_t max_queue_bytes = 64 * 1024 * 1024,
+               FsyncPolicy fsync_policy = FsyncPolicy::None,
+               std::chrono::milliseconds fsync_interval = std::chrono::milliseconds(1000),
+               PageCodec::Method compression = PageCodec::Method::None, size_t dictionary_samples = 0,
+               bool deduplicate = true);
+    ~PageWriter();
+
+    // Queues a page for writing, blocking while the queue is full
+    void submit(PageRecord page);
+    // Waits until every page submitted before the call has been written
+    void flush();
+    // Drains the queue and stops the writer thread
+    void close();
+
+    PageWriterStats getStats() const;
+    void printStats() const;
+};
@@ -1,13 +1,36 @@
 #pragma once
 #include <string>
-#include <queue>
-#include <unordered_set>
+#include <vector>
+#include "url_canonicalizer.h"
+#include "robots.h"
 
 class LinkParser {
 public:
-    static void extractLinks(const std::string& html,
-        const std::string& base_url,
-        std::queue<std::string>& url_queue,
-        std::unordered_set<std::string>& visited
+    // "tokenizer" scans the raw HTML for <a href> and <base href> in a single
+    // pass without building a tree; "gumbo" walks a full Gumbo DOM.
+    enum class Engine { Tokenizer, Gumbo };
+    static bool engineFromName(const std::string& name, Engine& engine);
+
+    // How extractLinks() rewrites and filters links, and what it reports back
+    struct LinkFilter {
+        const UrlCanonicalizer* canonicalizer = nullptr;    // Rewrites links to canonical form
+        const RobotsRules* robots = nullptr;                // Drops links robots.txt disallows
+        std::vector<std::string>* resolved = nullptr;       // Gets each returned link before canonicalization
+        size_t disallowed = 0;                              // Links dropped for robots.txt
+    };
+
+    // Returns the absolute HTTP(S) links on the page that stay under scope,
+    // resolved against page_url (or the page's <base href>) and passed
+    // through filter, if given.
+    // Touches no shared state, so pages can be parsed without holding any lock.
+    static std::vector<std::string> extractLinks(const std::string& html,
+        const std::string& page_url,
+        const std::string& scope,
+        Engine engine = Engine::Tokenizer,
+        LinkFilter* filter = nullptr
     );
-};
\ No newline at end of file
+
+    // Raw href values in document order, plus the first <base href> if any
+    static void extractHrefsTokenizer(const std::string& html, std::vector<std::string>& hrefs, std::string& base_href);
+    static void extractHrefsGumbo(const std::string& html, std::vector<std::string>& hrefs, std::string& base_href);
+};
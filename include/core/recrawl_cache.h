@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <fstream>
+#include <mutex>
+#include "downloader.h"
+
+// State kept between crawls of the same output directory for incremental
+// recrawls: every URL stored so far, with the ETag and Last-Modified values
+// of its last fetch (<output>/.validators). A recrawl seeds the frontier
+// with these URLs and fetches them conditionally, so unchanged pages cost a
+// 304 without body, storage or parsing.
+//
+// Pages stored by the current run (new or changed) are listed one URL per
+// line in <output>/changed.txt, for the processing stage to pick up.
+class RecrawlCache {
+private:
+    std::string directory;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Validators> entries;
+    std::ofstream changed_list;
+    uint64_t changed_count = 0;
+
+public:
+    explicit RecrawlCache(const std::string& directory);
+
+    // Returns false if no earlier crawl left a cache
+    bool load();
+    bool save() const;
+
+    bool lookup(const std::string& url, Validators& validators) const;
+    // Records a page stored by this run, with the validators from its headers
+    void recordChanged(const std::string& url, const std::string& headers);
+    // Drops a URL that no longer exists
+    void forget(const std::string& url);
+
+    std::vector<std::string> urls() const;
+    size_t size() const;
+    uint64_t changedCount() const;
+
+    // Starts this run's changed-pages list, continuing it on resume
+    bool openChangedList(bool append);
+    void flushChangedList();
+
+    static Validators parseValidators(const std::string& headers);
+    static std::string changedListPath(const std::string& directory);
+    static bool readChangedList(const std::string& path, std::unordered_set<std::string>& urls);
+};
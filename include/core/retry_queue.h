@@ -0,0 +1,79 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <cstdint>
+#include "downloader.h"
+#include "timer_wheel.h"
+
+// Fetches that failed for a reason that may pass (a timeout, a reset
+// connection, a 429 or a 5xx gateway error) are fetched again later instead
+// of being dropped. Each URL may be retried max_retries times. The n-th
+// retry waits base_delay * 2^(n-1), capped at max_delay, half of it fixed
+// and half random, so the URLs of one failing burst do not come back
+// together. A Retry-After header (seconds or an HTTP date) is a lower bound
+// on the wait; one longer than max_delay gives the URL up.
+//
+// Waiting URLs sit in a TimerWheel. A timer thread hands them to the
+// requeue callback when they are due, so workers only record the failure
+// and move on.
+class RetryQueue {
+public:
+    using Requeue = std::function<void(const std::string& url)>;
+
+    struct Stats {
+        uint64_t scheduled = 0;     // Retries scheduled
+        uint64_t retry_after = 0;   // Of them, waiting at least as long as a Retry-After
+        uint64_t requeued = 0;      // Handed back to be fetched again
+        uint64_t recovered = 0;     // URLs fetched successfully after failing
+        uint64_t exhausted = 0;     // URLs given up with retryable failures
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    int max_retries;
+    std::chrono::milliseconds base_delay;
+    std::chrono::milliseconds max_delay;
+    Requeue requeue;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    TimerWheel wheel;
+    std::unordered_map<std::string, int> attempts;  // Retries so far, until the URL succeeds or is given up
+    std::mt19937_64 random;
+    Stats stats;
+    bool stopping = false;
+    std::thread timer_thread;
+
+    void timerLoop();
+    std::chrono::milliseconds backoff(int retry);
+
+public:
+    RetryQueue(int max_retries, std::chrono::milliseconds base_delay, std::chrono::milliseconds max_delay,
+               Requeue requeue);
+    // URLs still waiting are dropped
+    ~RetryQueue();
+    RetryQueue(const RetryQueue&) = delete;
+    RetryQueue& operator=(const RetryQueue&) = delete;
+
+    // Whether the failure in result may pass if the URL is fetched again
+    static bool retryable(const DownloadResult& result);
+    // Seconds a response's Retry-After asks to wait, -1 without one
+    static long retryAfter(const std::string& headers);
+
+    // Takes every finished fetch. Returns true if the URL was scheduled to be
+    // fetched again; false if it succeeded, failed for good or is out of
+    // retries, and the caller handles the result as usual.
+    bool retry(const DownloadResult& result);
+
+    size_t waiting() const;
+    Stats getStats() const;
+    void printStats() const;
+};
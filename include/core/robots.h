@@ -0,0 +1,103 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include "downloader.h"
+
+// The rules of one robots.txt (RFC 9309) that apply to our user agent,
+// compiled for fast checks. Plain path prefixes go into a byte trie that is
+// walked once per check; only patterns with '*' or a trailing '$' are
+// matched one by one. The longest matching pattern decides, and Allow wins
+// a tie.
+class RobotsRules {
+private:
+    enum Verdict : int8_t { kNone = 0, kAllow = 1, kDisallow = 2 };
+
+    struct Node {
+        std::vector<std::pair<char, uint32_t>> children;
+        Verdict verdict = kNone;
+    };
+    struct Pattern {
+        std::string pattern;    // Without a trailing '$'
+        bool anchored;          // Must match the whole path
+        bool allow;
+    };
+
+    std::vector<Node> trie{1};
+    std::vector<Pattern> wildcards;
+    std::chrono::milliseconds crawl_delay{0};
+    std::vector<std::string> sitemap_urls;
+    size_t rule_count = 0;
+
+    void addRule(std::string pattern, bool allow);
+
+public:
+    // Rules of the groups for agent (matched case-insensitively), or of the
+    // "*" groups if none names it
+    static RobotsRules parse(const std::string& body, const std::string& agent);
+    static RobotsRules disallowAll();
+
+    // path_and_query is everything from the path on, e.g. "/a/b?c=d"
+    bool allowed(std::string_view path_and_query) const;
+    bool allowedUrl(const std::string& url) const;
+
+    std::chrono::milliseconds crawlDelay() const { return crawl_delay; }
+    // Sitemap lines apply to every agent
+    const std::vector<std::string>& sitemaps() const { return sitemap_urls; }
+    size_t ruleCount() const { return rule_count; }
+};
+
+// robots.txt of every host seen, each fetched once and kept for a TTL.
+// A missing robots.txt (4xx) allows everything; one that cannot be fetched
+// (5xx or a transfer error) disallows the whole host until it is retried.
+class RobotsCache {
+public:
+    // Fetches a robots.txt URL, e.g. with Downloader::fetch
+    using Fetcher = std::function<DownloadResult(const std::string& url)>;
+    // Called after every fetch, e.g. to apply the Crawl-delay
+    using FetchListener = std::function<void(const std::string& origin, const RobotsRules& rules)>;
+
+    struct Stats {
+        uint64_t hosts = 0;
+        uint64_t fetches = 0;
+        uint64_t unreachable = 0;   // Fetches that ended in a disallow-all
+    };
+
+private:
+    struct Entry {
+        std::shared_ptr<const RobotsRules> rules;
+        std::chrono::steady_clock::time_point expires;
+        bool fetching = false;
+    };
+
+    std::string agent;
+    std::chrono::seconds ttl;
+    Fetcher fetcher;
+    FetchListener listener;
+
+    mutable std::mutex mutex;
+    std::condition_variable fetched;
+    std::unordered_map<std::string, Entry> entries;
+    uint64_t fetch_count = 0;
+    uint64_t unreachable_count = 0;
+
+    std::shared_ptr<const RobotsRules> fetchRules(const std::string& origin, bool& unreachable);
+
+public:
+    RobotsCache(const std::string& agent, std::chrono::seconds ttl, Fetcher fetcher,
+                FetchListener listener = nullptr);
+
+    // Rules for origin ("scheme://host[:port]"). The first caller for a host
+    // fetches its robots.txt while later callers wait; once the TTL has run
+    // out, one caller refetches while the others keep using the old rules.
+    std::shared_ptr<const RobotsRules> rulesFor(const std::string& origin);
+
+    Stats getStats() const;
+};
@@ -0,0 +1,118 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include "page_codec.h"
+
+// A stored fetch: one WARC record
+struct PageRecord {
+    std::string url;
+    std::string fetch_time;     // WARC-Date, ISO 8601 UTC
+    std::string headers;        // Raw HTTP response headers, empty if unknown
+    std::string body;
+    std::string digest;         // WARC-Payload-Digest of the body, empty if not computed
+    // Set for a revisit record: the body is identical to the one stored for
+    // refers_to at refers_to_date and is not repeated
+    std::string refers_to;
+    std::string refers_to_date;
+};
+
+// Append-only page storage in WARC 1.0 format. Records go into segment files
+// (pages-NNNNN.warc) that roll over once they reach the size limit. Each
+// segment has a text index (pages-NNNNN.idx) with one "offset length url"
+// line per record, so single pages can be read without scanning.
+//
+// Bodies are stored decoded, as curl delivers them, so a response's
+// Content-Encoding, Transfer-Encoding and wire Content-Length are renamed to
+// X-Crawler-Original-* and a Content-Length of the stored body is set.
+//
+// A writer never reopens existing segments: a new writer in the same
+// directory starts after the highest segment number found there.
+//
+// A record with refers_to set is written as a WARC revisit record
+// (identical-payload-digest profile) holding only the response headers.
+//
+// With a codec, each record's block (headers and body) is stored as a zlib
+// stream and marked with "WARC-Block-Encoding: deflate". Readers decode such
+// records transparently; generic WARC tools will see the compressed block.
+class SegmentWriter {
+private:
+    std::string directory;
+    uint64_t segment_bytes;
+    PageCodec* codec;
+    uint64_t raw_block_bytes = 0;       // Blocks before and after compression
+    uint64_t stored_block_bytes = 0;
+    uint64_t next_segment_id = 0;
+    int data_fd = -1;
+    int index_fd = -1;
+    uint64_t offset = 0;        // Size of the current segment, buffered bytes included
+    uint64_t flushed_data = 0;  // Bytes of the segment and its index known to be written
+    uint64_t flushed_index = 0;
+    uint64_t segments_written = 0;
+    uint64_t failed_flushes = 0;
+    std::string data_buffer;
+    std::string index_buffer;
+
+    bool openSegment();
+    bool closeSegment();
+
+public:
+    explicit SegmentWriter(const std::string& directory, uint64_t segment_bytes = 256ull * 1024 * 1024,
+                           PageCodec* codec = nullptr);
+    ~SegmentWriter();
+
+    // Returns false if the record was not buffered or a write it triggered failed
+    bool append(const PageRecord& record);
+    // Writes buffered records to the segment and index files
+    bool flush();
+    // flush() followed by fsync of both files
+    bool sync();
+    void close();
+
+    uint64_t segmentCount() const { return segments_written; }
+    // Failed writes so far. Each drops every record buffered since the last
+    // flush; one inside append() also fails that append.
+    uint64_t failedFlushes() const { return failed_flushes; }
+    uint64_t rawBlockBytes() const { return raw_block_bytes; }
+    uint64_t storedBlockBytes() const { return stored_block_bytes; }
+
+    static std::string formatDate(std::chrono::system_clock::time_point time);
+};
+
+class SegmentReader {
+public:
+    struct IndexEntry {
+        uint64_t offset = 0;
+        uint64_t length = 0;
+        std::string url;
+    };
+
+private:
+    std::ifstream in;
+    std::string path;
+    PageCodec* codec;
+    std::unique_ptr<PageCodec> own_codec;   // Created for the first compressed record without a codec
+
+    // Sets decoded to false for a compressed record that could not be decoded
+    bool readRecord(PageRecord& record, bool& decoded);
+
+public:
+    // Compressed records are decoded with codec, which also collects the
+    // decompression stats; by default the reader uses its own
+    explicit SegmentReader(const std::string& path, PageCodec* codec = nullptr);
+
+    bool isOpen() const { return in.is_open(); }
+    // Reads the next record. Returns false at the end of the segment or at a
+    // truncated record left by an interrupted write. Records that fail to
+    // decompress are reported and skipped.
+    bool next(PageRecord& record);
+    bool readAt(uint64_t offset, PageRecord& record);
+
+    // Segment files in a directory, oldest first
+    static std::vector<std::string> listSegments(const std::string& directory);
+    static bool isSegmentFile(const std::string& path);
+    static bool readIndex(const std::string& segment_path, std::vector<IndexEntry>& entries);
+};
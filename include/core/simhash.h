@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+// 64-bit SimHash (Charikar) of the visible text of an HTML page. Every run
+// of three words is hashed, and each bit of the fingerprint is the majority
+// vote of that bit over all the hashes, so pages whose text differs a little
+// get fingerprints a few bits apart.
+class SimHash {
+public:
+    // Pages with fewer word triples than this are too short to compare
+    static constexpr size_t kMinFeatures = 8;
+
+    // Fingerprint of the text outside tags, scripts and styles. features
+    // receives the number of word triples hashed.
+    static uint64_t fromHtml(const std::string& html, size_t* features = nullptr);
+    static int distance(uint64_t a, uint64_t b);
+};
+
+// Fingerprints of the most recent pages, indexed to find one within a
+// Hamming distance of a new fingerprint. The 64 bits are split into
+// threshold + 1 bands: two fingerprints at most threshold bits apart agree
+// on at least one whole band, so only fingerprints sharing a band with the
+// new one are compared. Once window fingerprints are indexed, the oldest is
+// dropped for each new one.
+class NearDuplicateIndex {
+public:
+    struct Match {
+        std::string url;        // Page the fingerprint was indexed for
+        int distance = 0;
+    };
+
+private:
+    struct Slot {
+        uint64_t fingerprint = 0;
+        std::string url;
+    };
+    struct Band {
+        int shift;
+        uint64_t mask;
+        std::unordered_map<uint64_t, std::vector<uint32_t>> slots;  // Band value -> slots holding it
+    };
+
+    int threshold;
+    std::vector<Band> bands;
+    std::vector<Slot> ring;     // At most window slots, reused oldest first
+    size_t window;
+    size_t next_slot = 0;
+    mutable std::mutex mutex;
+
+    uint64_t bandValue(const Band& band, uint64_t fingerprint) const {
+        return (fingerprint >> band.shift) & band.mask;
+    }
+
+public:
+    // threshold is clamped to [0, 16]
+    NearDuplicateIndex(int threshold, size_t window);
+
+    // Finds an indexed fingerprint at most threshold bits from fingerprint;
+    // without one, indexes fingerprint for url and returns false
+    bool findOrInsert(uint64_t fingerprint, const std::string& url, Match& match);
+    size_t size() const;
+    int getThreshold() const { return threshold; }
+};
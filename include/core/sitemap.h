@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <zlib.h>
+
+// Streaming parser for sitemaps (sitemaps.org protocol). A <urlset> lists
+// pages, a <sitemapindex> lists further sitemaps, and a plain text sitemap
+// has one URL per line. Input may arrive in chunks of any size and may be
+// gzip-compressed; memory use is bounded by the longest URL, never by the
+// size of the file.
+class SitemapParser {
+public:
+    // Called for every URL found; is_sitemap marks the entries of an index
+    using UrlCallback = std::function<void(std::string url, bool is_sitemap)>;
+
+private:
+    enum class State { Sniff, Text, Tag, TagRest, Comment, CData, PlainText };
+
+    UrlCallback callback;
+    State state = State::Sniff;
+    bool gzipped = false;
+    bool gzip_checked = false;
+    std::string gzip_magic;     // First bytes, until gzip can be told apart
+    z_stream inflater{};
+    bool inflater_ready = false;
+    bool corrupt = false;
+
+    std::string tag;            // Name of the tag being read
+    std::string loc;            // Text of the current <loc>, or the current line
+    bool in_loc = false, in_url = false, in_sitemap = false;
+    bool loc_overflow = false;
+    int marker_run = 0;         // Trailing '-' of a comment or ']' of a CDATA section
+    uint64_t url_count = 0;
+
+    bool consume(const char* data, size_t size);   // Inflates if needed, then scans
+    void scan(const char* data, size_t size);
+    void endTagName(char next);
+    void appendLoc(char c);
+    void emitLoc(bool xml);
+
+public:
+    explicit SitemapParser(UrlCallback callback);
+    ~SitemapParser();
+    SitemapParser(const SitemapParser&) = delete;
+    SitemapParser& operator=(const SitemapParser&) = delete;
+
+    // Returns false once the input turned out not to be a valid gzip stream
+    bool feed(const char* data, size_t size);
+    // Flushes a last plain-text line without line break
+    void finish();
+    uint64_t urlCount() const { return url_count; }
+};
+
+// Fetches sitemaps and follows sitemap indexes, handing the page URLs over
+// in batches as they are parsed.
+class SitemapLoader {
+public:
+    using BatchCallback = std::function<void(std::vector<std::string>& urls)>;
+
+    struct Stats {
+        uint64_t sitemaps = 0;  // Sitemaps and indexes read
+        uint64_t failed = 0;
+        uint64_t urls = 0;      // Page URLs listed
+        uint64_t bytes = 0;     // Decoded sitemap bytes
+    };
+
+private:
+    BatchCallback on_batch;
+    size_t max_sitemaps;
+    Stats stats;
+
+public:
+    explicit SitemapLoader(BatchCallback on_batch, size_t max_sitemaps = 1000);
+
+    // Reads every sitemap reachable from roots, at most max_sitemaps of them
+    void load(const std::vector<std::string>& roots);
+    Stats getStats() const { return stats; }
+};
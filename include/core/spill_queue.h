@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <cstdint>
+
+// FIFO of URLs stored in append-only segment files on disk. Writes are
+// buffered and appended sequentially; reads stream through the oldest
+// segment in batches. Fully consumed segments are deleted.
+//
+// For checkpointing, snapshot() records the read position and segment sizes.
+// With retention enabled, consumed segments are only deleted once a newer
+// checkpoint no longer references them (releaseRetired()), and segments are
+// left on disk when the queue is destroyed.
+class SpillQueue {
+public:
+    struct State {
+        std::vector<std::pair<std::string, uint64_t>> segments;    // File name, size in bytes
+        uint64_t read_offset = 0;
+        uint64_t count = 0;
+        uint64_t next_segment_id = 0;
+    };
+
+private:
+    std::string directory;
+    size_t segment_bytes;
+
+    struct Segment {
+        std::string path;
+        uint64_t bytes = 0;     // Bytes written so far
+    };
+    std::deque<Segment> segments;   // Oldest first; back() is the write segment
+    uint64_t next_segment_id = 0;
+
+    std::string write_buffer;
+    std::ofstream writer;
+    std::ifstream reader;
+    uint64_t read_offset = 0;       // Offset into segments.front()
+    size_t count = 0;               // URLs spilled and not yet read back
+    uint64_t total_spilled = 0;
+
+    bool retain_segments = false;
+    std::deque<std::string> retired;    // Consumed segments awaiting deletion
+
+    bool openWriteSegment();
+    void flushWriteBuffer();
+    void retireSegment(const std::string& path);
+
+public:
+    explicit SpillQueue(const std::string& directory, size_t segment_bytes = 64 * 1024 * 1024);
+    ~SpillQueue();
+
+    void push(const std::string& url);
+    // Reads up to max_items URLs, oldest first. Returns the number read.
+    size_t popBatch(std::vector<std::string>& out, size_t max_items);
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    uint64_t totalSpilled() const { return total_spilled; }
+
+    void setRetainSegments(bool retain) { retain_segments = retain; }
+    // Flushes buffered URLs and records the current queue position.
+    // retired_before receives the number of segments retired so far.
+    State snapshot(size_t& retired_before);
+    // Reopens the segments listed in a snapshot, truncating anything
+    // appended after it was taken
+    bool restore(const State& state);
+    // Deletes the oldest n retired segments
+    void releaseRetired(size_t n);
+};
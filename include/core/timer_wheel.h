@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+// Hierarchical timing wheel holding items until a point in time. Level 0
+// has a slot per tick for the next 64 ticks, and each level above covers 64
+// times the span of the one below. An item sits in the level matching how
+// far off it is and moves down a level whenever that level's slot comes
+// round, so scheduling is O(1) and advancing costs a slot per tick
+// however many items wait. Items further off than the top level spans
+// wait in its farthest slot and are placed again when it comes round.
+//
+// Not thread-safe; the owner locks around it.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    static constexpr int kLevels = 4;
+    static constexpr int kSlotBits = 6;
+    static constexpr uint64_t kSlots = uint64_t(1) << kSlotBits;
+
+    struct Timer {
+        uint64_t due;           // Tick it expires at
+        std::string item;
+    };
+
+    std::chrono::milliseconds tick_length;
+    Clock::time_point origin;
+    uint64_t current = 0;       // Ticks since origin handled so far
+    size_t count = 0;
+    std::vector<Timer> slots[kLevels][kSlots];
+
+    void place(Timer timer);
+    void cascade(int level);
+
+public:
+    explicit TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(50));
+
+    // Holds item until due; items already due expire on the next advance()
+    void schedule(std::string item, Clock::time_point due);
+    // Appends the items due by now to expired, earlier ticks first
+    void advance(Clock::time_point now, std::vector<std::string>& expired);
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    std::chrono::milliseconds tick() const { return tick_length; }
+};
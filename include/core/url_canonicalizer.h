@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+// RFC 3986 reference resolution and URL normalization.
+//
+// resolve() implements section 5.2: merging a relative reference with its
+// base and removing "." and ".." segments. canonicalize() applies the
+// syntax- and scheme-based normalizations of section 6.2: lowercase scheme
+// and host, uppercase percent-escapes, decoding of unreserved characters,
+// dot-segment removal, dropping the default port, "/" for an empty path and
+// dropping the fragment, which never reaches the server. On top of that come
+// the configurable rules, which may change which resource a URL names on
+// some sites and can therefore be turned off.
+//
+// Two URLs with the same canonical form are fetched once.
+class UrlCanonicalizer {
+public:
+    struct Rules {
+        bool drop_tracking = true;   // Drop utm_*, gclid, fbclid, session ids, ...
+        bool sort_query = true;      // Order query parameters by name
+        std::vector<std::string> drop_params;   // More names to drop; a trailing '*' matches a prefix
+    };
+    // names: comma-separated "drop-tracking" and "sort-query", or "none"
+    static bool rulesFromNames(const std::string& names, Rules& rules);
+
+    UrlCanonicalizer() = default;
+    explicit UrlCanonicalizer(const Rules& rules);
+
+    // Canonical form of an absolute URL. Only http and https URLs are
+    // rewritten; anything else comes back unchanged.
+    std::string canonicalize(const std::string& url) const;
+
+    // Target URL of reference ref found in a document at base. Returns an
+    // empty string if ref is relative and base is not an absolute URL.
+    static std::string resolve(const std::string& base, const std::string& ref);
+    static std::string removeDotSegments(std::string_view path);
+
+private:
+    Rules rules;
+
+    bool dropParam(std::string_view name) const;
+    std::string normalizeQuery(const std::string& query) const;
+};
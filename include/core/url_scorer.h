@@ -0,0 +1,65 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+// Priority of a URL for the best-first frontier; higher is fetched sooner.
+// A score is the sum of
+//   - the weights of the URL patterns its path and query match,
+//   - minus depth_weight for every link between the URL and a seed,
+//   - plus inlink_weight * log2(1 + links to the URL seen so far),
+//   - plus whatever a scorer plugin returns for it.
+// Under the bfs policy every URL scores 0, so the frontier stays in arrival
+// order.
+class UrlScorer {
+public:
+    enum class Policy { Bfs, BestFirst };
+    // "scoreUrl" of a scorer plugin; called from several threads at once
+    using PluginFunction = double (*)(const char* url, int depth, unsigned int inlinks);
+
+    struct Weights {
+        double depth = 1.0;
+        double inlinks = 1.0;
+        // robots.txt-style patterns ('*' wildcard, '$' anchor) on path and query
+        std::vector<std::pair<std::string, double>> patterns;
+    };
+
+private:
+    struct Pattern {
+        std::string pattern;    // Without a trailing '$'
+        bool anchored;
+        double weight;
+    };
+
+    Policy policy = Policy::Bfs;
+    std::vector<Pattern> patterns;
+    double depth_weight = 0;
+    double inlink_weight = 0;
+    PluginFunction plugin = nullptr;
+    // Count-min sketch of the links seen to each URL. Its size is fixed, and
+    // collisions can only make a count too high, never too low.
+    std::unique_ptr<std::atomic<uint32_t>[]> inlink_counts;
+
+    size_t slot(size_t hash, int row) const;
+
+public:
+    static bool policyFromName(const std::string& name, Policy& policy);
+    static const char* policyName(Policy policy);
+    // Parses "PATTERN=WEIGHT,..."; a pattern may itself contain '='
+    static bool weightsFromSpec(const std::string& spec, Weights& weights);
+
+    UrlScorer() = default;
+    UrlScorer(Policy policy, const Weights& weights, PluginFunction plugin = nullptr);
+
+    double score(const std::string& url, int depth) const;
+    // Records one more link to each of urls, duplicates included
+    void countInlinks(const std::vector<std::string>& urls);
+    unsigned int inlinks(const std::string& url) const;
+
+    Policy getPolicy() const { return policy; }
+    // Scores of queued URLs rise as links to them are found, so the frontier
+    // has to rescore them now and then
+    bool dynamic() const { return static_cast<bool>(inlink_counts); }
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <string_view>
+
+// Non-owning view of the components of a URL (RFC 3986, section 3):
+//
+//   scheme ":" [ "//" authority ] path [ "?" query ] [ "#" fragment ]
+//   authority = [ userinfo "@" ] host [ ":" port ]
+//
+// Parsing splits the string in one pass without allocating; every accessor
+// returns a slice of the original string, which must outlive the view.
+// Components that are absent come back empty; has*() tells an absent
+// component from an empty one.
+class UrlView {
+private:
+    std::string_view url;
+    std::string_view scheme_, authority_, userinfo_, host_, port_, path_, query_, fragment_;
+    bool has_scheme = false, has_authority = false, has_query = false, has_fragment = false;
+
+public:
+    UrlView() = default;
+    explicit UrlView(std::string_view url);
+
+    std::string_view str() const { return url; }
+    std::string_view scheme() const { return scheme_; }
+    std::string_view authority() const { return authority_; }
+    std::string_view userinfo() const { return userinfo_; }
+    std::string_view host() const { return host_; }     // IPv6 literals keep their brackets
+    std::string_view port() const { return port_; }
+    std::string_view path() const { return path_; }
+    std::string_view query() const { return query_; }
+    std::string_view fragment() const { return fragment_; }
+
+    bool hasScheme() const { return has_scheme; }
+    bool hasAuthority() const { return has_authority; }
+    bool hasQuery() const { return has_query; }
+    bool hasFragment() const { return has_fragment; }
+
+    // Scheme compared case-insensitively against a lowercase name
+    bool schemeIs(std::string_view name) const;
+    // An http or https URL with an authority
+    bool isHttp() const { return has_authority && (schemeIs("http") || schemeIs("https")); }
+
+    // "scheme://authority" of an http(s) URL, empty for anything else
+    std::string_view origin() const;
+    // Path and query without the fragment, e.g. "/a/b?c=d"
+    std::string_view pathAndQuery() const;
+};
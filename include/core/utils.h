@@ -1,10 +1,20 @@
 #pragma once
 #include <string>
+#include <string_view>
 
 class Utils {
 public:
     static std::string extractBaseDomain(const std::string& url);
     static std::string createSafeFilename(const std::string& url);
     static bool createOutputDirectory(const std::string& dir);
+    // Writes all of data to fd, retrying short and interrupted writes.
+    // Returns false with errno set if a write fails.
+    static bool writeAll(int fd, const std::string& data);
     static std::string resolveUrl(const std::string& base_url, const std::string& link);
+    // robots.txt-style match: '*' matches any run of characters, and unless
+    // anchored the pattern only has to match a prefix of text
+    static bool globMatch(std::string_view pattern, std::string_view text, bool anchored);
+    // Whether the name of a header line, the text before its colon, is name
+    // (given in lowercase), ignoring case
+    static bool headerNameIs(const std::string& line, size_t colon, const char* name);
 };
\ No newline at end of file
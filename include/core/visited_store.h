@@ -0,0 +1,147 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <unordered_map>
+
+// Set of URLs the crawler has already seen. Implementations store 64-bit
+// fingerprints instead of full URLs.
+class VisitedStore {
+public:
+    virtual ~VisitedStore() = default;
+
+    // Records the URL. Returns true if it had not been seen before.
+    virtual bool insert(const std::string& url) = 0;
+    virtual bool contains(const std::string& url) const = 0;
+    virtual size_t size() const = 0;
+    virtual size_t memoryUsage() const = 0;    // Bytes
+    virtual std::string getName() const = 0;
+
+    // Checkpoint support: clone() takes a point-in-time copy that can be
+    // written out by save() while the original keeps changing.
+    virtual std::unique_ptr<VisitedStore> clone() const = 0;
+    virtual bool save(std::ostream& out) const = 0;
+    virtual bool load(std::istream& in) = 0;
+
+    static uint64_t fingerprint(const std::string& url);
+
+    // mode: "fingerprint" (default) or "bloom"
+    static std::unique_ptr<VisitedStore> create(const std::string& mode, double false_positive_rate = 0.001);
+};
+
+// Open-addressing hash table of 64-bit URL fingerprints (linear probing).
+// Exact up to fingerprint collisions, about 8-16 bytes per URL.
+class FingerprintVisitedStore : public VisitedStore {
+private:
+    std::vector<uint64_t> slots;    // 0 marks an empty slot
+    size_t count = 0;
+
+    static uint64_t nonZero(uint64_t fp) { return fp ? fp : 1; }
+    bool insertFingerprint(uint64_t fp);
+    void grow();
+
+public:
+    explicit FingerprintVisitedStore(size_t initial_capacity = 1024);
+
+    bool insert(const std::string& url) override;
+    bool contains(const std::string& url) const override;
+    size_t size() const override { return count; }
+    size_t memoryUsage() const override { return slots.capacity() * sizeof(uint64_t); }
+    std::string getName() const override { return "fingerprint"; }
+
+    std::unique_ptr<VisitedStore> clone() const override;
+    bool save(std::ostream& out) const override;
+    bool load(std::istream& in) override;
+};
+
+// Scalable Bloom filter: a chain of filters with geometrically growing
+// capacity and tightening error rates, so the overall false-positive rate
+// stays below the configured bound however many URLs are added.
+// A false positive means a new URL is wrongly treated as already visited.
+class BloomVisitedStore : public VisitedStore {
+private:
+    struct Filter {
+        std::vector<uint64_t> bits;
+        uint64_t num_bits = 0;
+        int num_hashes = 0;
+        size_t capacity = 0;
+        size_t count = 0;
+    };
+
+    std::vector<Filter> filters;
+    double false_positive_rate;
+    size_t initial_capacity;
+    size_t count = 0;
+
+    void addFilter();
+    static bool filterContains(const Filter& filter, uint64_t h1, uint64_t h2);
+
+public:
+    explicit BloomVisitedStore(double false_positive_rate = 0.001, size_t initial_capacity = 65536);
+
+    bool insert(const std::string& url) override;
+    bool contains(const std::string& url) const override;
+    size_t size() const override { return count; }
+    size_t memoryUsage() const override;
+    std::string getName() const override { return "bloom"; }
+
+    std::unique_ptr<VisitedStore> clone() const override;
+    bool save(std::ostream& out) const override;
+    bool load(std::istream& in) override;
+};
+
+// Thread-safe visited set striped over independently locked shards. Each URL
+// belongs to the shard picked by its fingerprint, so workers recording links
+// at the same time rarely wait on each other.
+//
+// clone() is copy-on-write: the copy shares every shard's store, which costs
+// O(shards) however many URLs are stored. While a store is shared, new URLs
+// of that shard wait in a small pending map next to it; they are merged in
+// by the first insert after the other owner let go of the store.
+class ShardedVisitedStore : public VisitedStore {
+private:
+    struct Shard {
+        std::shared_ptr<VisitedStore> store;    // Never changed while shared
+        std::unordered_map<uint64_t, std::string> pending;  // By fingerprint, inserted while shared
+        mutable std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::string mode;
+    double false_positive_rate;
+
+    size_t shardIndex(uint64_t fp) const { return (fp >> 32) % shards.size(); }
+    // With the shard locked
+    static bool shared(const Shard& shard);
+    static void mergePending(Shard& shard);
+    static bool insertLocked(Shard& shard, const std::string& url, uint64_t fp);
+    static bool containsLocked(const Shard& shard, const std::string& url, uint64_t fp);
+    // Every URL of the shard in a store of its own
+    static std::shared_ptr<VisitedStore> copyLocked(const Shard& shard);
+
+    ShardedVisitedStore(std::vector<std::unique_ptr<Shard>> shards, const std::string& mode,
+                        double false_positive_rate);
+
+public:
+    ShardedVisitedStore(const std::string& mode, double false_positive_rate = 0.001, size_t num_shards = 16);
+    // Takes over existing stores as shards, e.g. one loaded from an older checkpoint
+    explicit ShardedVisitedStore(std::vector<std::unique_ptr<VisitedStore>> stores);
+
+    // Records a batch of URLs, taking each shard lock once. URLs that had not
+    // been seen before are appended to fresh in their original order.
+    void insertBatch(const std::vector<std::string>& urls, std::vector<std::string>& fresh);
+    size_t shardCount() const { return shards.size(); }
+
+    bool insert(const std::string& url) override;
+    bool contains(const std::string& url) const override;
+    size_t size() const override;
+    size_t memoryUsage() const override;
+    std::string getName() const override { return mode; }
+
+    std::unique_ptr<VisitedStore> clone() const override;
+    bool save(std::ostream& out) const override;
+    bool load(std::istream& in) override;
+};
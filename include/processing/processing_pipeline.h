@@ -2,12 +2,15 @@
 #include "processor.h"
 #include "query_system.h"
 #include "thread_pool.h"
+#include "segment_store.h"
+#include "page_codec.h"
 #include <filesystem>
 #include <queue>
 #include <string>
 #include <vector>
 #include <sqlite3.h>
 #include <memory>
+#include <unordered_set>
 
 class ProcessingPipeline {
 private:
@@ -18,6 +21,9 @@ private:
     std::string plugins_directory;
     std::unique_ptr<ThreadPool> thread_pool;
     size_t num_threads;
+    std::unique_ptr<PageCodec> codec;   // Decodes compressed pages and times it
+    bool changed_only = false;
+    std::unordered_set<std::string> changed_pages;  // URLs from a recrawl's changed-pages list
 
     std::unordered_map<std::string, PluginConfig> processor_configs;
     
@@ -29,6 +35,9 @@ public:
     
     void addProcessor(const std::string& processor_name);
     void setOutputFormat(const std::string& format);
+    // Restricts processing to the newest copy of the pages in a changed-pages
+    // list written by an incremental recrawl
+    bool setChangedPages(const std::string& list_path);
     bool loadPlugins();
 
     void setProcessorConfig(const std::string& processor_name, const PluginConfig& config);
@@ -40,7 +49,11 @@ public:
     // Process with filtering
     std::vector<ProcessedData> processWithFilter(DataQuery* query);
 
+    // Reads an .html file, or a compressed .html.z file written by the crawler
     std::unique_ptr<ProcessedData> processSingleFile(const std::filesystem::directory_entry& entry);
+    // A page read from a WARC segment written by the crawler
+    std::unique_ptr<ProcessedData> processRecord(const PageRecord& record);
+    std::unique_ptr<ProcessedData> processContent(const std::string& url, const std::string& content);
     std::vector<ProcessedData> processFilteredFiles(DataQuery* query);
     
     // Export results
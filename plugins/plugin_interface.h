@@ -9,6 +9,9 @@ extern "C" {
     typedef const char* (*GetPluginNameFunction)();
     typedef const char* (*GetPluginVersionFunction)();
     typedef const char* (*GetPluginDescriptionFunction)();
+
+    // URL scorer plugins export "scoreUrl" to steer the best-first crawl policy
+    typedef double (*ScoreUrlFunction)(const char* url, int depth, unsigned int inlinks);
 }
 
 // Plugin loader class
@@ -16,4 +19,6 @@ class PluginLoader {
 public:
     static bool loadPlugin(const std::string& plugin_path, ProcessorRegistry& registry);
     static std::vector<std::string> findPlugins(const std::string& plugins_directory);
+    // Returns nullptr if the library cannot be loaded or exports no scoreUrl
+    static ScoreUrlFunction loadScorer(const std::string& plugin_path);
 };
\ No newline at end of file
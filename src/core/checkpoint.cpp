@@ -0,0 +1,163 @@
+#include "checkpoint.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+
+constexpr int kCheckpointVersion = 1;
+
+// Falls back to the previous checkpoint if a swap was interrupted
+std::string existingDirectory(const std::string& output_dir) {
+    std::error_code ec;
+    std::string current = Checkpoint::directory(output_dir);
+    if (std::filesystem::exists(current + "/state.txt", ec)) return current;
+    if (std::filesystem::exists(current + ".old/state.txt", ec)) return current + ".old";
+    return "";
+}
+
+bool readState(const std::string& dir, std::unordered_map<std::string, std::string>& state) {
+    std::ifstream in(dir + "/state.txt");
+    if (!in.is_open()) return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t eq = line.find('=');
+        if (eq != std::string::npos) {
+            state[line.substr(0, eq)] = line.substr(eq + 1);
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+std::string Checkpoint::directory(const std::string& output_dir) {
+    return output_dir + "/.checkpoint";
+}
+
+bool Checkpoint::exists(const std::string& output_dir) {
+    return !existingDirectory(output_dir).empty();
+}
+
+bool Checkpoint::write(const std::string& output_dir, const CrawlCheckpoint& checkpoint) {
+    namespace fs = std::filesystem;
+    std::string final_dir = directory(output_dir);
+    std::string tmp_dir = final_dir + ".tmp";
+    std::error_code ec;
+
+    fs::remove_all(tmp_dir, ec);
+    if (!fs::create_directories(tmp_dir, ec)) {
+        std::cerr << "Could not create checkpoint directory '" << tmp_dir << "': " << ec.message() << std::endl;
+        return false;
+    }
+
+    {
+        std::ofstream state(tmp_dir + "/state.txt");
+        state << "version=" << kCheckpointVersion << "\n";
+        state << "start_url=" << checkpoint.start_url << "\n";
+        state << "downloaded_count=" << checkpoint.downloaded_count << "\n";
+        state << "visited_store=" << checkpoint.visited->getName() << "\n";
+        if (auto* sharded = dynamic_cast<const ShardedVisitedStore*>(checkpoint.visited.get())) {
+            state << "visited_shards=" << sharded->shardCount() << "\n";
+        }
+        state << "spill_read_offset=" << checkpoint.spill.read_offset << "\n";
+        state << "spill_count=" << checkpoint.spill.count << "\n";
+        state << "spill_next_segment=" << checkpoint.spill.next_segment_id << "\n";
+
+        std::ofstream segments(tmp_dir + "/spill.txt");
+        for (const auto& segment : checkpoint.spill.segments) {
+            segments << segment.first << " " << segment.second << "\n";
+        }
+
+        std::ofstream frontier(tmp_dir + "/frontier.txt", std::ios::binary);
+        for (const auto& url : checkpoint.frontier_urls) {
+            frontier << url << "\n";
+        }
+
+        std::ofstream visited(tmp_dir + "/visited.bin", std::ios::binary);
+        checkpoint.visited->save(visited);
+
+        if (!state || !segments || !frontier || !visited) {
+            std::cerr << "Failed to write checkpoint files in " << tmp_dir << std::endl;
+            return false;
+        }
+    }
+
+    // Swap the new checkpoint in: current -> .old, .tmp -> current
+    std::string old_dir = final_dir + ".old";
+    fs::remove_all(old_dir, ec);
+    if (fs::exists(final_dir, ec)) {
+        fs::rename(final_dir, old_dir, ec);
+        if (ec) {
+            std::cerr << "Could not rotate checkpoint: " << ec.message() << std::endl;
+            return false;
+        }
+    }
+    fs::rename(tmp_dir, final_dir, ec);
+    if (ec) {
+        std::cerr << "Could not install checkpoint: " << ec.message() << std::endl;
+        return false;
+    }
+    fs::remove_all(old_dir, ec);
+    return true;
+}
+
+bool Checkpoint::readStartUrl(const std::string& output_dir, std::string& start_url) {
+    std::string dir = existingDirectory(output_dir);
+    std::unordered_map<std::string, std::string> state;
+    if (dir.empty() || !readState(dir, state)) return false;
+    start_url = state["start_url"];
+    return !start_url.empty();
+}
+
+bool Checkpoint::read(const std::string& output_dir, CrawlCheckpoint& checkpoint) {
+    std::string dir = existingDirectory(output_dir);
+    std::unordered_map<std::string, std::string> state;
+    if (dir.empty() || !readState(dir, state)) {
+        std::cerr << "No checkpoint found in " << output_dir << std::endl;
+        return false;
+    }
+    if (state["version"] != std::to_string(kCheckpointVersion)) {
+        std::cerr << "Unsupported checkpoint version: " << state["version"] << std::endl;
+        return false;
+    }
+
+    try {
+        checkpoint.start_url = state["start_url"];
+        checkpoint.downloaded_count = std::stoi(state["downloaded_count"]);
+        checkpoint.spill.read_offset = std::stoull(state["spill_read_offset"]);
+        checkpoint.spill.count = std::stoull(state["spill_count"]);
+        checkpoint.spill.next_segment_id = std::stoull(state["spill_next_segment"]);
+    } catch (const std::exception& e) {
+        std::cerr << "Corrupt checkpoint state in " << dir << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    // The shard count is stored in visited.bin itself
+    if (state.count("visited_shards")) {
+        checkpoint.visited = std::make_unique<ShardedVisitedStore>(state["visited_store"], 0.001, 1);
+    } else {
+        checkpoint.visited = VisitedStore::create(state["visited_store"]);
+    }
+    std::ifstream visited(dir + "/visited.bin", std::ios::binary);
+    if (!visited.is_open() || !checkpoint.visited->load(visited)) {
+        std::cerr << "Could not load visited set from checkpoint" << std::endl;
+        return false;
+    }
+
+    std::ifstream segments(dir + "/spill.txt");
+    std::string name;
+    uint64_t bytes;
+    while (segments >> name >> bytes) {
+        checkpoint.spill.segments.emplace_back(name, bytes);
+    }
+
+    std::ifstream frontier(dir + "/frontier.txt", std::ios::binary);
+    std::string url;
+    while (std::getline(frontier, url)) {
+        if (!url.empty()) checkpoint.frontier_urls.push_back(url);
+    }
+    return true;
+}
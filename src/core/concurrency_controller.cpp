@@ -0,0 +1,171 @@
+#include "concurrency_controller.h"
+#include "frontier.h"
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+// Fewest fetches a decision is based on, however low the limit
+constexpr size_t kMinWindow = 4;
+// Windows whose average latency make up a host's recent best
+constexpr size_t kRecentWindows = 16;
+// Latency counts as risen above twice the recent best, and by at least this
+// much, so jitter on fast hosts does not look like a queue building up
+constexpr uint64_t kLatencySlackUs = 50000;
+
+} // namespace
+
+ConcurrencyController::ConcurrencyController(int min_limit, int max_limit, const std::string& log_path,
+                                             LimitCallback on_limit)
+    : min_limit(std::max(1, min_limit)), max_limit(std::max(std::max(1, min_limit), max_limit)),
+      on_limit(std::move(on_limit)), log_path(log_path), start_time(Clock::now()) {}
+
+ConcurrencyController::HostState& ConcurrencyController::stateFor(const std::string& host) {
+    auto inserted = hosts.try_emplace(host);
+    HostState& state = inserted.first->second;
+    if (inserted.second) {
+        state.limit = min_limit;
+        state.window_start = Clock::now();
+    }
+    return state;
+}
+
+void ConcurrencyController::started(const std::string& url) {
+    std::string host = Frontier::hostKey(url);
+    std::lock_guard<std::mutex> lock(mutex);
+    HostState& state = stateFor(host);
+    state.started[url] = Clock::now();
+    state.peak = std::max(state.peak, static_cast<int>(state.started.size()));
+}
+
+void ConcurrencyController::finished(const DownloadResult& result) {
+    std::string host = Frontier::hostKey(result.url);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = hosts.find(host);
+    if (it == hosts.end()) return;
+    HostState& state = it->second;
+    auto fetch = state.started.find(result.url);
+    if (fetch == state.started.end()) return;
+
+    Clock::time_point start = fetch->second;
+    state.started.erase(fetch);
+    // It ran under the limit before the last decrease and says nothing about the current one
+    if (start < state.last_decrease) return;
+
+    Clock::time_point now = Clock::now();
+    state.fetches++;
+    state.latency_us += std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+    state.bytes += result.body_bytes;
+    if (result.status_code == 429 || result.status_code == 503) {
+        state.throttled++;
+    } else if (result.status_code >= 500 || (result.error != CURLE_OK && result.abort_reason == AbortReason::None)) {
+        state.failures++;
+    }
+
+    if (state.fetches >= std::max<size_t>(kMinWindow, state.limit)) {
+        decide(host, state, now);
+    }
+}
+
+void ConcurrencyController::decide(const std::string& host, HostState& state, Clock::time_point now) {
+    uint64_t average_us = state.latency_us / state.fetches;
+    uint64_t best_us = state.recent.empty() ? average_us : *std::min_element(state.recent.begin(), state.recent.end());
+    double seconds = std::chrono::duration<double>(now - state.window_start).count();
+
+    int previous = state.limit;
+    const char* reason = nullptr;
+    if (state.throttled > 0) {
+        reason = "throttled";
+        stats.throttled++;
+    } else if (state.failures * 10 >= state.fetches) {
+        reason = "errors";
+        stats.errors++;
+    } else if (average_us > 2 * best_us && average_us - best_us > kLatencySlackUs) {
+        reason = "latency";
+        stats.latency++;
+    }
+
+    if (reason) {
+        state.limit = std::max(min_limit, previous / 2);
+        state.slow_start = false;
+        state.last_decrease = now;
+    } else if (state.peak < previous) {
+        reason = "idle";    // The host did not use the limit it had
+    } else if (previous >= max_limit) {
+        reason = "at max";
+    } else {
+        reason = state.slow_start ? "slow start" : "increase";
+        state.limit = std::min(max_limit, state.slow_start ? previous * 2 : previous + 1);
+        stats.increases++;
+    }
+    stats.decisions++;
+
+    writeLog(host, previous, state.limit, reason, state, average_us, seconds);
+    if (state.limit != previous) {
+        std::cout << "Concurrency for " << host << ": " << previous << " -> " << state.limit << " (" << reason << ")"
+                  << std::endl;
+        if (on_limit) on_limit(host, state.limit);
+    }
+
+    // Refusals come back fast, so only clean windows say how fast the host is
+    if (state.throttled == 0 && state.failures == 0) {
+        state.recent.push_back(average_us);
+        if (state.recent.size() > kRecentWindows) state.recent.pop_front();
+    }
+    state.window_start = now;
+    state.fetches = 0;
+    state.throttled = 0;
+    state.failures = 0;
+    state.latency_us = 0;
+    state.bytes = 0;
+    state.peak = static_cast<int>(state.started.size());
+}
+
+void ConcurrencyController::writeLog(const std::string& host, int previous, int limit, const char* reason,
+                                     const HostState& state, uint64_t average_us, double seconds) {
+    if (log_path.empty()) return;
+    if (!log.is_open()) {
+        std::error_code ec;
+        bool fresh = !std::filesystem::exists(log_path, ec) || std::filesystem::file_size(log_path, ec) == 0;
+        log.open(log_path, std::ios::app);
+        if (!log.is_open()) {
+            std::cerr << "Failed to open " << log_path << ", concurrency decisions are not logged" << std::endl;
+            log_path.clear();
+            return;
+        }
+        if (fresh) {
+            log << "seconds,host,previous,limit,reason,fetches,avg_latency_ms,pages_per_sec,kb_per_sec,error_rate\n";
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - start_time).count();
+    double rate = seconds > 0 ? state.fetches / seconds : 0.0;
+    double kb_rate = seconds > 0 ? state.bytes / 1024.0 / seconds : 0.0;
+    log << std::fixed << std::setprecision(3) << elapsed << ',' << host << ',' << previous << ',' << limit << ','
+        << reason << ',' << state.fetches << ',' << average_us / 1000.0 << ',' << rate << ',' << kb_rate << ','
+        << static_cast<double>(state.throttled + state.failures) / state.fetches << '\n';
+    log.flush();
+}
+
+ConcurrencyController::Stats ConcurrencyController::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void ConcurrencyController::printStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << "Adaptive concurrency: " << stats.decisions << " decisions, " << stats.increases << " increases, "
+              << stats.throttled + stats.errors + stats.latency << " decreases (" << stats.throttled << " throttled, "
+              << stats.errors << " errors, " << stats.latency << " latency); limits within " << min_limit << ".."
+              << max_limit;
+    size_t shown = 0;
+    for (const auto& entry : hosts) {
+        if (shown++ == 5) break;
+        std::cout << (shown == 1 ? " now " : ", ") << entry.first << " " << entry.second.limit;
+    }
+    if (hosts.size() > 5) std::cout << " and " << hosts.size() - 5 << " more hosts";
+    if (!log_path.empty() && stats.decisions > 0) std::cout << "; series in " << log_path;
+    std::cout << std::endl;
+}
@@ -0,0 +1,241 @@
+#include "content_index.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+const char* const kMapFile = "content.map";
+
+inline uint32_t rotl(uint32_t x, int bits) {
+    return (x << bits) | (x >> (32 - bits));
+}
+
+void sha1Block(uint32_t state[5], const unsigned char* block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = uint32_t(block[i * 4]) << 24 | uint32_t(block[i * 4 + 1]) << 16 |
+               uint32_t(block[i * 4 + 2]) << 8 | uint32_t(block[i * 4 + 3]);
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        uint32_t t = rotl(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotl(b, 30);
+        b = a;
+        a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+// Parses "K DIGEST DATE URL"
+bool parseLine(const std::string& line, char& kind, std::string& digest, std::string& date, std::string& url) {
+    std::istringstream fields(line);
+    std::string marker;
+    if (!(fields >> marker >> digest >> date) || marker.size() != 1) return false;
+    kind = marker[0];
+    if (kind != '+' && kind != '=') return false;
+    std::getline(fields >> std::ws, url);
+    return !url.empty();
+}
+
+} // namespace
+
+ContentIndex::ContentIndex(const std::string& directory, bool overwrites)
+    : directory(directory), overwrites(overwrites) {}
+
+ContentIndex::~ContentIndex() {
+    flush();
+    if (map_fd >= 0) ::close(map_fd);
+}
+
+std::string ContentIndex::mapPath(const std::string& directory) {
+    return directory + "/" + kMapFile;
+}
+
+std::string ContentIndex::digest(const std::string& data) {
+    uint32_t state[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+    size_t full = data.size() / 64 * 64;
+    for (size_t i = 0; i < full; i += 64) {
+        sha1Block(state, p + i);
+    }
+
+    // The last block is padded with 0x80, zeros and the length in bits
+    unsigned char tail[128] = {};
+    size_t rest = data.size() - full;
+    std::memcpy(tail, p + full, rest);
+    tail[rest] = 0x80;
+    size_t tail_size = rest < 56 ? 64 : 128;
+    uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+    for (int i = 0; i < 8; ++i) {
+        tail[tail_size - 1 - i] = static_cast<unsigned char>(bits >> (i * 8));
+    }
+    sha1Block(state, tail);
+    if (tail_size == 128) sha1Block(state, tail + 64);
+
+    unsigned char hash[20];
+    for (int i = 0; i < 20; ++i) {
+        hash[i] = static_cast<unsigned char>(state[i / 4] >> (24 - (i % 4) * 8));
+    }
+
+    // RFC 4648 base32: 160 bits are exactly 32 characters
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+    std::string out = "sha1:";
+    uint32_t buffer = 0;
+    int pending = 0;
+    for (unsigned char byte : hash) {
+        buffer = (buffer << 8) | byte;
+        pending += 8;
+        while (pending >= 5) {
+            out += alphabet[(buffer >> (pending - 5)) & 31];
+            pending -= 5;
+        }
+    }
+    return out;
+}
+
+bool ContentIndex::load() {
+    std::ifstream in(mapPath(directory));
+    if (!in.is_open()) return false;
+
+    std::string line, digest, date, url;
+    char kind;
+    while (std::getline(in, line)) {
+        // A torn last line from an interrupted write is skipped
+        if (!parseLine(line, kind, digest, date, url)) continue;
+        if (overwrites) {
+            digests[url] = digest;
+            if (kind == '+') originals[digest] = Original{url, date};
+        } else if (kind == '+') {
+            // Stored records are never overwritten, so the first copy stays valid
+            originals.emplace(digest, Original{url, date});
+        }
+    }
+
+    // A body whose URL has since been given another body is gone
+    if (overwrites) {
+        for (auto it = originals.begin(); it != originals.end();) {
+            auto current = digests.find(it->second.url);
+            if (current == digests.end() || current->second != it->first) {
+                it = originals.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    return true;
+}
+
+const ContentIndex::Original* ContentIndex::find(const std::string& digest) const {
+    auto it = originals.find(digest);
+    return it == originals.end() ? nullptr : &it->second;
+}
+
+std::string ContentIndex::digestOf(const std::string& url) const {
+    auto it = digests.find(url);
+    return it == digests.end() ? std::string() : it->second;
+}
+
+bool ContentIndex::record(const std::string& url, const std::string& fetch_time, const std::string& digest) {
+    bool stored = originals.emplace(digest, Original{url, fetch_time}).second;
+    if (stored) unflushed.push_back(digest);
+    if (overwrites) digests[url] = digest;
+    append(stored ? '+' : '=', digest, fetch_time, url);
+    return stored;
+}
+
+std::string ContentIndex::transfer(const std::string& url, const std::string& digest) {
+    auto original = originals.find(digest);
+    if (original == originals.end() || original->second.url != url) return "";
+
+    // Rare (a shared body changing under its URL), so a scan is fine
+    for (const auto& entry : digests) {
+        if (entry.second == digest && entry.first != url) {
+            original->second.url = entry.first;
+            append('+', digest, original->second.fetch_time, entry.first);
+            return entry.first;
+        }
+    }
+    originals.erase(original);
+    return "";
+}
+
+void ContentIndex::append(char kind, const std::string& digest, const std::string& fetch_time, const std::string& url) {
+    buffer += kind;
+    buffer += ' ';
+    buffer += digest;
+    buffer += ' ';
+    buffer += fetch_time.empty() ? "-" : fetch_time;
+    buffer += ' ';
+    buffer += url;
+    buffer += '\n';
+}
+
+bool ContentIndex::flush(bool sync) {
+    unflushed.clear();
+    if (buffer.empty() && !sync) return true;
+    if (map_fd < 0) {
+        if (!Utils::createOutputDirectory(directory)) return false;
+        std::string path = mapPath(directory);
+        map_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (map_fd < 0) {
+            std::cerr << "Failed to open " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    bool ok = Utils::writeAll(map_fd, buffer);
+    if (!ok) {
+        std::cerr << "Failed to write the content map: " << std::strerror(errno) << std::endl;
+    }
+    buffer.clear();
+    return ok && (!sync || fsync(map_fd) == 0);
+}
+
+void ContentIndex::discard() {
+    for (const std::string& digest : unflushed) {
+        originals.erase(digest);
+    }
+    unflushed.clear();
+    buffer.clear();
+}
+
+bool ContentIndex::readMap(const std::string& path, std::unordered_map<std::string, std::string>& url_digests) {
+    std::ifstream in(path);
+    if (!in.is_open()) return false;
+
+    std::string line, digest, date, url;
+    char kind;
+    while (std::getline(in, line)) {
+        if (parseLine(line, kind, digest, date, url)) url_digests[url] = digest;
+    }
+    return true;
+}
@@ -1,78 +1,588 @@
 #include "crawler.h"
 #include "downloader.h"
+#include "multi_downloader.h"
 #include "parser.h"
 #include "utils.h"
+#include "url_view.h"
+#include "checkpoint.h"
+#include "sitemap.h"
+#include "plugin_interface.h"
 #include <iostream>
-#include <fstream>
+#include <algorithm>
 #include <filesystem>
 #include <vector>
 #include <future>
 #include <mutex>
+#include <shared_mutex>
 #include <condition_variable>
 #include <atomic>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 // Thread safety
-std::mutex queue_mutex;
-std::mutex visited_mutex;
+// Held shared while a page's links are recorded in the visited set and the
+// frontier, and exclusively while a checkpoint copies both
+std::shared_mutex snapshot_mutex;
 std::atomic<int> downloaded_count{0};
+std::atomic<int> unchanged_count{0};
+std::atomic<uint64_t> links_seen{0};
+std::atomic<uint64_t> alias_links{0};
+std::atomic<uint64_t> duplicates_avoided{0};
+std::atomic<uint64_t> robots_disallowed{0};
+std::atomic<uint64_t> near_duplicates{0};
+
+namespace {
+
+// Product token of the User-Agent the downloader sends
+const char* const kRobotsAgent = "WebCrawler";
+// Longer Crawl-delays are capped rather than stalling the crawl for hours
+constexpr std::chrono::milliseconds kMaxCrawlDelay{60000};
+// getaddrinfo calls run in parallel by the DNS prefetcher
+constexpr size_t kResolverThreads = 4;
+
+// robots.txt-style pattern on the path and query, '$' anchoring its end
+bool matchesPattern(const std::string& pattern, const std::string& url) {
+    bool anchored = !pattern.empty() && pattern.back() == '$';
+    std::string_view path = UrlView(url).pathAndQuery();
+    return Utils::globMatch(std::string_view(pattern).substr(0, pattern.size() - anchored),
+                            path.empty() ? std::string_view("/") : path, anchored);
+}
+
+} // namespace
 std::atomic<bool> should_stop{false};
 
 
 WebCrawler::WebCrawler(const std::string& start_url, const CrawlOptions& opts)
     : start_url(start_url), options(opts) 
 {
-    base_domain = Utils::extractBaseDomain(start_url);
+    UrlCanonicalizer::Rules rules;
+    std::stringstream drop_params(options.drop_params);
+    std::string param;
+    while (std::getline(drop_params, param, ',')) {
+        if (!param.empty()) rules.drop_params.push_back(param);
+    }
+    if (!UrlCanonicalizer::rulesFromNames(options.url_rules, rules)) {
+        std::cerr << "Unknown URL rules '" << options.url_rules << "', using drop-tracking,sort-query" << std::endl;
+    }
+    canonicalizer = UrlCanonicalizer(rules);
+    aliases = std::make_unique<ShardedVisitedStore>("fingerprint");
+
+    UrlScorer::Policy policy = UrlScorer::Policy::Bfs;
+    if (!UrlScorer::policyFromName(options.crawl_policy, policy)) {
+        std::cerr << "Unknown crawl policy '" << options.crawl_policy << "', using bfs" << std::endl;
+    }
+    UrlScorer::Weights weights;
+    weights.depth = options.depth_weight;
+    weights.inlinks = options.inlink_weight;
+    if (!UrlScorer::weightsFromSpec(options.url_weights, weights)) {
+        std::cerr << "Invalid URL weights '" << options.url_weights << "', ignoring them" << std::endl;
+        weights.patterns.clear();
+    }
+    UrlScorer::PluginFunction plugin = nullptr;
+    if (!options.scorer_plugin.empty()) plugin = PluginLoader::loadScorer(options.scorer_plugin);
+    if (policy == UrlScorer::Policy::Bfs && (plugin || !weights.patterns.empty())) {
+        std::cerr << "URL weights and scorer plugins only apply to the best-first policy" << std::endl;
+    }
+    scorer = UrlScorer(policy, weights, plugin);
+
+    // Links are compared in canonical form, so the start URL must be too
+    this->start_url = canonicalizer.canonicalize(start_url);
+    base_domain = Utils::extractBaseDomain(this->start_url);
     std::cout << "Base domain: " << base_domain << std::endl;
-    url_queue.push(start_url);
-    visited.insert(start_url);
+    if (options.dns_prefetch || !options.dns_hosts.empty()) {
+        resolver = std::make_unique<DnsResolver>(kResolverThreads, std::chrono::seconds(options.dns_ttl_sec));
+        if (!options.dns_hosts.empty() && !resolver->loadHostsFile(options.dns_hosts)) {
+            std::cerr << "Could not read hosts file " << options.dns_hosts << std::endl;
+        }
+        Downloader::setResolver(resolver.get());
+        resolver->prefetch({this->start_url});
+    }
+    int per_host = options.max_per_host;
+    if (options.adaptive_concurrency) {
+        // Limits never exceed what the engine runs at once, nor --max-per-host
+        int ceiling = options.max_in_flight > 0 ? options.max_in_flight : options.concurrent_threads;
+        if (options.max_per_host > 0) ceiling = std::min(ceiling, options.max_per_host);
+        concurrency = std::make_unique<ConcurrencyController>(options.min_per_host, ceiling,
+            options.output_dir + "/concurrency.csv",
+            [this](const std::string& host, int limit) { frontier->setHostLimit(host, limit); });
+        // Hosts start at the lower bound until the controller raises them
+        per_host = concurrency->initialLimit();
+    }
+    frontier = std::make_unique<Frontier>(std::chrono::milliseconds(options.host_delay_ms), per_host,
+                                          options.frontier_memory_mb * 1024 * 1024,
+                                          options.output_dir + "/.frontier");
+    if (options.max_retries > 0) {
+        retries = std::make_unique<RetryQueue>(options.max_retries, std::chrono::milliseconds(options.retry_delay_ms),
+                                               std::chrono::seconds(options.retry_max_delay_sec),
+                                               [this](const std::string& url) { frontier->requeue(url); });
+    }
+    if (policy == UrlScorer::Policy::BestFirst) {
+        frontier->setScorer([this](const std::string& url, int depth) { return scorer.score(url, depth); },
+                            scorer.dynamic());
+    }
+    if (!LinkParser::engineFromName(options.link_parser, link_engine)) {
+        std::cerr << "Unknown link parser '" << options.link_parser << "', using tokenizer" << std::endl;
+    }
+    download_limits.html_only = options.html_only;
+    download_limits.max_body_bytes = static_cast<uint64_t>(options.max_page_kb) * 1024;
 
-    // Initialize the thread pool
-    thread_pool = std::make_unique<ThreadPool>(options.concurrent_threads);
-    
     // Reset atomic counters
     downloaded_count = 0;
+    unchanged_count = 0;
+    links_seen = 0;
+    alias_links = 0;
+    duplicates_avoided = 0;
+    robots_disallowed = 0;
+    near_duplicates = 0;
     should_stop = false;
+
+    if (options.skip_near_dups) {
+        near_dups = std::make_unique<NearDuplicateIndex>(options.near_dup_bits, options.near_dup_window);
+    }
+
+    if (options.respect_robots) {
+        // robots.txt is plain text, so it is fetched without the HTML-only limits
+        robots = std::make_unique<RobotsCache>(kRobotsAgent, std::chrono::seconds(options.robots_ttl_sec),
+            [](const std::string& url) {
+                DownloadLimits limits;
+                limits.max_body_bytes = 512 * 1024;
+                return Downloader::fetch(url, Validators(), limits);
+            },
+            [this](const std::string& origin, const RobotsRules& rules) {
+                std::chrono::milliseconds delay = std::min(rules.crawlDelay(), kMaxCrawlDelay);
+                frontier->setHostDelay(origin, delay);
+                std::cout << "robots.txt of " << origin << ": " << rules.ruleCount() << " rules";
+                if (delay.count() > 0) std::cout << ", crawl delay " << delay.count() << " ms";
+                std::cout << std::endl;
+            });
+    }
+
+    resumed = options.resume && loadCheckpoint();
+    if (!resumed) {
+        if (options.resume) {
+            std::cerr << "Could not resume from " << options.output_dir << ", starting a new crawl" << std::endl;
+        }
+        visited = std::make_unique<ShardedVisitedStore>(options.visited_store, options.bloom_fp_rate);
+        if (robots && !robots->rulesFor(base_domain)->allowedUrl(this->start_url)) {
+            std::cerr << "robots.txt disallows the start URL " << this->start_url << std::endl;
+        } else {
+            frontier->push(this->start_url);
+        }
+        visited->insert(this->start_url);
+    }
+
+    if (options.incremental) {
+        recrawl_cache = std::make_unique<RecrawlCache>(options.output_dir);
+        // A resumed crawl already holds the seeded URLs in its checkpoint
+        if (recrawl_cache->load() && !resumed) {
+            std::vector<std::string> known;
+            std::shared_ptr<const RobotsRules> rules = robots ? robots->rulesFor(base_domain) : nullptr;
+            for (const auto& url : recrawl_cache->urls()) {
+                if (UrlView(url).origin() != base_domain) continue;
+                if (rules && !rules->allowedUrl(url)) continue;
+                known.push_back(url);
+            }
+            std::vector<std::string> fresh;
+            visited->insertBatch(known, fresh);
+            std::cout << "Incremental recrawl: " << fresh.size() << " known URLs queued for revalidation" << std::endl;
+            if (resolver) resolver->prefetch(fresh);
+            frontier->pushBatch(std::move(fresh));
+        }
+    }
+
+    if (!resumed && !options.sitemaps.empty()) seedFromSitemaps();
+
+    // Spill segments must outlive consumption while a checkpoint may refer to them
+    frontier->setRetainSpill(options.checkpoint_interval_sec > 0);
+
+    // Initialize the thread pool
+    thread_pool = std::make_unique<ThreadPool>(options.concurrent_threads);
+}
+
+WebCrawler::~WebCrawler() {
+    if (resolver) Downloader::setResolver(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(checkpoint_mutex);
+        checkpoint_stop = true;
+    }
+    checkpoint_cv.notify_all();
+    if (checkpoint_thread.joinable()) {
+        checkpoint_thread.join();
+    }
 }
 
 void WebCrawler::crawl() {
-    const std::string outDir = "output";
-    if (!Utils::createOutputDirectory(outDir)) {
+    if (!Utils::createOutputDirectory(options.output_dir)) {
         std::cerr << "Failed to create output directory" << std::endl;
         return;
     }
 
+    PageWriter::Format storage_format = PageWriter::Format::Segments;
+    if (!PageWriter::formatFromName(options.storage_format, storage_format)) {
+        std::cerr << "Unknown storage format '" << options.storage_format << "', using segments" << std::endl;
+    }
+    PageWriter::FsyncPolicy fsync_policy = PageWriter::FsyncPolicy::None;
+    if (!PageWriter::policyFromName(options.fsync_policy, fsync_policy)) {
+        std::cerr << "Unknown fsync policy '" << options.fsync_policy << "', using none" << std::endl;
+    }
+    PageCodec::Method compression = PageCodec::Method::None;
+    if (!PageCodec::methodFromName(options.compression, compression)) {
+        std::cerr << "Unknown compression '" << options.compression << "', storing pages uncompressed" << std::endl;
+    }
+    page_writer = std::make_unique<PageWriter>(options.output_dir, storage_format,
+                                               static_cast<uint64_t>(options.segment_size_mb) * 1024 * 1024,
+                                               options.write_queue_mb * 1024 * 1024, fsync_policy,
+                                               std::chrono::milliseconds(options.fsync_interval_ms),
+                                               compression, options.dictionary_samples, !options.store_duplicates);
+    if (recrawl_cache) recrawl_cache->openChangedList(resumed);
+
+    if (options.checkpoint_interval_sec > 0) {
+        checkpoint_stop = false;
+        checkpoint_thread = std::thread([this]() { this->checkpointLoop(); });
+    }
+
+    if (options.max_in_flight > 0) {
+        crawlEventDriven();
+    } else {
+        // Create futures for all worker threads
+        std::vector<std::future<void>> futures;
+
+        // Launch worker threads
+        for (int i = 0; i < options.concurrent_threads; ++i) {
+            futures.emplace_back(
+                thread_pool->enqueue([this]() {
+                    this->workerFunction();
+                })
+            );
+        }
+
+        // Wait for all threads to complete
+        for (auto& future : futures) {
+            try {
+                future.wait();
+            } catch (...) {
+                // Handle exceptions if needed
+            }
+        }
+    }
 
-    // Create futures for all worker threads
-    std::vector<std::future<void>> futures;
-    
-    // Launch worker threads
-    for (int i = 0; i < options.concurrent_threads; ++i) {
-        futures.emplace_back(
-            thread_pool->enqueue([this]() {
-                this->workerFunction();
-            })
-        );
+    // Every queued page is on disk before the final checkpoint and summary
+    page_writer->close();
+    if (recrawl_cache) {
+        recrawl_cache->flushChangedList();
+        recrawl_cache->save();
     }
 
-    // Wait for all threads to complete
-    for (auto& future : futures) {
-        try {
-            future.wait();
-        } catch (...) {
-            // Handle exceptions if needed
+    if (options.checkpoint_interval_sec > 0) {
+        {
+            std::lock_guard<std::mutex> lock(checkpoint_mutex);
+            checkpoint_stop = true;
         }
+        checkpoint_cv.notify_all();
+        checkpoint_thread.join();
+
+        // Final checkpoint so a crawl stopped by --max-pages can be continued
+        writeCheckpoint();
     }
 
+    printSummary();
+}
+
+bool WebCrawler::loadCheckpoint() {
+    CrawlCheckpoint checkpoint;
+    if (!Checkpoint::read(options.output_dir, checkpoint)) {
+        return false;
+    }
+    if (!frontier->restore(checkpoint.frontier_urls, checkpoint.spill)) {
+        return false;
+    }
+
+    if (auto* sharded = dynamic_cast<ShardedVisitedStore*>(checkpoint.visited.get())) {
+        checkpoint.visited.release();
+        visited.reset(sharded);
+    } else {
+        // Checkpoints written before sharding hold a single store
+        std::vector<std::unique_ptr<VisitedStore>> stores;
+        stores.push_back(std::move(checkpoint.visited));
+        visited = std::make_unique<ShardedVisitedStore>(std::move(stores));
+    }
+    downloaded_count = checkpoint.downloaded_count;
+    pages_before = checkpoint.downloaded_count;
+    std::cout << "Resumed crawl: " << checkpoint.downloaded_count << " pages done, "
+              << frontier->size() << " URLs queued, " << visited->size() << " URLs seen" << std::endl;
+    return true;
+}
+
+bool WebCrawler::writeCheckpoint() {
+    CrawlCheckpoint checkpoint;
+    checkpoint.start_url = start_url;
+    size_t retired_segments = 0;
+
+    {
+        // Link recording holds snapshot_mutex shared, so holding it exclusively
+        // gives a consistent copy. Only in-memory copies are taken here; the
+        // visited set's is copy-on-write and costs a step per shard.
+        std::unique_lock<std::shared_mutex> snapshot_lock(snapshot_mutex);
+        checkpoint.visited = visited->clone();
+        frontier->snapshot(checkpoint.frontier_urls, checkpoint.spill, retired_segments);
+        checkpoint.downloaded_count = downloaded_count.load();
+    }
+
+    // Pages completed before the snapshot must be stored before it is written
+    if (page_writer) page_writer->flush();
+    if (recrawl_cache) {
+        recrawl_cache->flushChangedList();
+        recrawl_cache->save();
+    }
+
+    // Serialization and disk I/O run without holding any crawler lock
+    if (!Checkpoint::write(options.output_dir, checkpoint)) {
+        std::cerr << "Checkpoint failed" << std::endl;
+        return false;
+    }
+    frontier->releaseSpill(retired_segments);
+    return true;
+}
+
+void WebCrawler::checkpointLoop() {
+    std::unique_lock<std::mutex> lock(checkpoint_mutex);
+    while (!checkpoint_stop) {
+        checkpoint_cv.wait_for(lock, std::chrono::seconds(options.checkpoint_interval_sec));
+        if (checkpoint_stop) break;
+
+        lock.unlock();
+        writeCheckpoint();
+        lock.lock();
+    }
+}
+
+// Bulk-loads the frontier and the visited set with the pages listed in
+// sitemaps, before any link is followed
+void WebCrawler::seedFromSitemaps() {
+    std::vector<std::string> roots;
+    for (const auto& sitemap : options.sitemaps) {
+        if (sitemap != "auto") {
+            roots.push_back(sitemap);
+            continue;
+        }
+        // The Sitemap lines of robots.txt, or the conventional location
+        std::vector<std::string> listed;
+        if (robots) listed = robots->rulesFor(base_domain)->sitemaps();
+        if (listed.empty()) listed.push_back(base_domain + "/sitemap.xml");
+        roots.insert(roots.end(), listed.begin(), listed.end());
+    }
+
+    uint64_t queued = 0, out_of_scope = 0, disallowed = 0;
+    std::shared_ptr<const RobotsRules> rules = robots ? robots->rulesFor(base_domain) : nullptr;
+    SitemapLoader loader([&](std::vector<std::string>& urls) {
+        std::vector<std::string> links;
+        links.reserve(urls.size());
+        for (const auto& url : urls) {
+            std::string canonical = canonicalizer.canonicalize(url);
+            if (UrlView(canonical).origin() != base_domain) {
+                out_of_scope++;
+            } else if (rules && !rules->allowedUrl(canonical)) {
+                disallowed++;
+            } else {
+                links.push_back(std::move(canonical));
+            }
+        }
+        std::vector<std::string> fresh;
+        visited->insertBatch(links, fresh);
+        queued += fresh.size();
+        if (resolver) resolver->prefetch(fresh);
+        frontier->pushBatch(std::move(fresh));
+    });
+    loader.load(roots);
+
+    SitemapLoader::Stats stats = loader.getStats();
+    std::cout << "Sitemaps: " << stats.sitemaps << " read (" << stats.failed << " failed, "
+              << stats.bytes / 1024 << " KB), " << stats.urls << " URLs listed, " << queued << " queued ("
+              << out_of_scope << " outside " << base_domain << ", " << disallowed << " disallowed by robots.txt)"
+              << std::endl;
+}
+
+void WebCrawler::printSummary() const {
     std::cout << "Crawled " << downloaded_count.load() << " pages" << std::endl;
+    Downloader::printStats();
+    if (resolver) resolver->printStats();
+    if (concurrency) concurrency->printStats();
+    if (retries) retries->printStats();
+    if (page_writer) page_writer->printStats();
+    uint64_t avoided = duplicates_avoided.load();
+    uint64_t fetches = static_cast<uint64_t>(downloaded_count.load()) + avoided;
+    std::cout << "URL canonicalization: " << alias_links.load() << " of " << links_seen.load()
+              << " links rewritten, " << avoided << " duplicate fetches avoided ("
+              << (fetches ? avoided * 100.0 / fetches : 0.0) << "% of fetches)" << std::endl;
+    if (robots) {
+        RobotsCache::Stats stats = robots->getStats();
+        std::cout << "robots.txt: " << stats.fetches << " fetches for " << stats.hosts << " hosts ("
+                  << stats.unreachable << " unreachable), " << robots_disallowed.load() << " links disallowed"
+                  << std::endl;
+    }
+    if (recrawl_cache) {
+        std::cout << "Incremental recrawl: " << unchanged_count.load() << " unchanged (304), "
+                  << recrawl_cache->changedCount() << " new or changed, " << recrawl_cache->size()
+                  << " URLs known" << std::endl;
+    }
+    if (near_dups) {
+        uint64_t skipped = near_duplicates.load();
+        int pages = downloaded_count.load() - pages_before;
+        std::cout << "Near-duplicates: " << skipped << " of " << pages << " pages (" << (pages ? skipped * 100.0 / pages : 0.0)
+                  << "%) within " << near_dups->getThreshold() << " bits of a recent page, not stored or expanded"
+                  << std::endl;
+    }
+    std::cout << "Visited store (" << visited->getName() << "): " << visited->size() << " URLs, "
+              << visited->memoryUsage() / 1024 << " KB" << std::endl;
+    if (!options.target_pattern.empty()) {
+        std::lock_guard<std::mutex> lock(target_mutex);
+        int pages = downloaded_count.load() - pages_before;
+        // Share of matching pages among the first `first` pages crawled
+        auto yield = [&](int first) {
+            size_t hits = std::count_if(target_hits.begin(), target_hits.end(), [first](int n) { return n <= first; });
+            return first > 0 ? hits * 100.0 / first : 0.0;
+        };
+        std::cout << "Yield (" << UrlScorer::policyName(scorer.getPolicy()) << "): " << target_hits.size()
+                  << " of " << pages << " pages match '" << options.target_pattern << "' (" << yield(pages)
+                  << "%), " << yield(pages / 4) << "% of the first quarter, " << yield(pages / 2)
+                  << "% of the first half" << std::endl;
+    }
+    if (frontier->spilledCount() > 0) {
+        std::cout << "Frontier: " << frontier->spilledCount() << " URLs spilled to disk, "
+                  << frontier->size() << " left unvisited" << std::endl;
+    }
+}
+
+bool WebCrawler::processPage(DownloadResult&& page) {
+    // Left in progress so the final checkpoint still holds the URL
+    if (should_stop.load()) return false;
+
+    int current_count = downloaded_count.fetch_add(1) + 1;
+
+    if (near_dups && isNearDuplicate(page)) {
+        // Neither stored nor expanded, but the fetch counts against the page limit
+        if (options.max_pages != -1 && current_count >= options.max_pages) {
+            should_stop.store(true);
+            frontier->close();
+        }
+        frontier->complete(page.url);
+        return true;
+    }
+
+    // Parse without any lock, then record the whole batch in the sharded
+    // visited set and frontier
+    std::vector<std::string> resolved;
+    LinkParser::LinkFilter filter;
+    filter.canonicalizer = &canonicalizer;
+    filter.resolved = &resolved;
+    // Every link kept is under base_domain, so one host's rules cover them all
+    std::shared_ptr<const RobotsRules> rules;
+    if (robots) {
+        rules = robots->rulesFor(base_domain);
+        filter.robots = rules.get();
+    }
+    std::vector<std::string> links = LinkParser::extractLinks(page.body, page.url, base_domain, link_engine, &filter);
+    robots_disallowed += filter.disallowed;
+    // Every link counts as an inlink, also to pages already seen
+    scorer.countInlinks(links);
+    int depth = frontier->depthOf(page.url);
+    {
+        std::shared_lock<std::shared_mutex> snapshot_lock(snapshot_mutex);
+        std::vector<std::string> fresh;
+        visited->insertBatch(links, fresh);
+        countAliases(links, resolved, fresh);
+        // Hosts are resolved while their URLs wait in the frontier
+        if (resolver) resolver->prefetch(fresh);
+        frontier->pushBatch(std::move(fresh), depth + 1);
+    }
+    if (!options.target_pattern.empty() && matchesPattern(options.target_pattern, page.url)) {
+        std::lock_guard<std::mutex> lock(target_mutex);
+        target_hits.push_back(current_count - pages_before);
+    }
+
+    if (recrawl_cache && page.status_code < 400) recrawl_cache->recordChanged(page.url, page.headers);
+
+    // Hand the page to the storage thread; blocks only when the disk falls behind
+    PageRecord record;
+    record.url = page.url;
+    record.fetch_time = SegmentWriter::formatDate(page.fetch_time);
+    record.headers = std::move(page.headers);
+    record.body = std::move(page.body);
+    page_writer->submit(std::move(record));
+
+    // Check if we've reached the limit
+    if (options.max_pages != -1 && current_count >= options.max_pages) {
+        should_stop.store(true);
+        frontier->close();
+    }
+    frontier->complete(page.url);
+    return true;
 }
 
-bool WebCrawler::tryPopUrl(std::string& url) {
-    std::lock_guard<std::mutex> lock(queue_mutex);
-    if (!url_queue.empty()) {
-        url = url_queue.front();
-        url_queue.pop();
+// A link spelled differently from its canonical form is an alias. A crawler
+// deduplicating raw URLs would fetch every new spelling of a page once; here
+// only the first spelling of a page not seen before costs a fetch.
+void WebCrawler::countAliases(const std::vector<std::string>& links, const std::vector<std::string>& resolved,
+                              const std::vector<std::string>& fresh) {
+    links_seen += links.size();
+    std::vector<std::string> spellings;
+    std::unordered_map<std::string, const std::string*> canonical_of;
+    std::unordered_set<std::string> plain;   // Links already in canonical form
+    for (size_t i = 0; i < links.size(); ++i) {
+        if (resolved[i] == links[i]) {
+            plain.insert(links[i]);
+            continue;
+        }
+        alias_links++;
+        if (canonical_of.emplace(resolved[i], &links[i]).second) spellings.push_back(resolved[i]);
+    }
+    if (spellings.empty()) return;
+
+    std::vector<std::string> new_spellings;
+    aliases->insertBatch(spellings, new_spellings);
+    std::unordered_set<std::string> fresh_set(fresh.begin(), fresh.end());
+    std::unordered_set<std::string> introduced;
+    uint64_t avoided = 0;
+    for (const auto& spelling : new_spellings) {
+        const std::string& canonical = *canonical_of[spelling];
+        bool first_spelling = fresh_set.count(canonical) && !plain.count(canonical) &&
+                              introduced.insert(canonical).second;
+        if (!first_spelling) avoided++;
+    }
+    duplicates_avoided += avoided;
+}
+
+// A page whose text is within near_dup_bits of a recent page, such as a
+// print view or a session variant, is a near-duplicate. Other pages are
+// added to the index.
+bool WebCrawler::isNearDuplicate(const DownloadResult& page) {
+    size_t features = 0;
+    uint64_t fingerprint = SimHash::fromHtml(page.body, &features);
+    if (features < SimHash::kMinFeatures) return false;
+
+    NearDuplicateIndex::Match match;
+    if (!near_dups->findOrInsert(fingerprint, page.url, match)) return false;
+    near_duplicates++;
+    std::cout << "Near-duplicate: " << page.url << " (of " << match.url << ", " << match.distance
+              << " bits apart)" << std::endl;
+    return true;
+}
+
+// Incremental recrawl bookkeeping for a finished fetch. Returns true for a
+// 304: the stored copy is current, so there is nothing to store or parse.
+bool WebCrawler::checkUnchanged(const DownloadResult& page) {
+    if (!recrawl_cache || page.error != CURLE_OK) return false;
+
+    if (page.status_code == 304) {
+        unchanged_count++;
+        frontier->complete(page.url);
         return true;
     }
+    // Gone pages are not revalidated by the next recrawl
+    if (page.status_code == 404 || page.status_code == 410) {
+        recrawl_cache->forget(page.url);
+    }
     return false;
 }
 
@@ -81,44 +591,111 @@ void WebCrawler::workerFunction() {
         // Check page limit
         if (options.max_pages != -1 && downloaded_count.load() >= options.max_pages) {
             should_stop.store(true);
+            frontier->close();
             break;
         }
 
+        // Blocks until a URL is eligible; false once the crawl is exhausted or stopped
         std::string url;
-        if (tryPopUrl(url)) {
-            std::cout << "Downloading: " << url << std::endl;
-            std::string html = Downloader::download(url);
-
-            if (!html.empty()) {
-                int current_count = downloaded_count.fetch_add(1) + 1;
-                
-                // Save HTML to file
-                std::string safe_filename = Utils::createSafeFilename(url);
-                std::string filename = options.output_dir + "/" + safe_filename + ".html";
-                {
-                    std::lock_guard<std::mutex> file_lock(queue_mutex); // Reuse mutex for file safety
-                    std::ofstream outfile(filename, std::ios::binary);
-                    outfile << html;
-                    outfile.close();
-                }
-                
-                // Extract links and add to queue (thread-safe)
-                {
-                    std::lock_guard<std::mutex> visited_lock(visited_mutex);
-                    LinkParser::extractLinks(html, base_domain, url_queue, visited);
-                }
-                
-                // Check if we've reached the limit
-                if (options.max_pages != -1 && current_count >= options.max_pages) {
-                    should_stop.store(true);
-                    break;
-                }
+        if (!frontier->waitPop(url)) break;
+
+        std::cout << "Downloading: " << url << std::endl;
+        Validators validators;
+        if (recrawl_cache) recrawl_cache->lookup(url, validators);
+        if (concurrency) concurrency->started(url);
+        DownloadResult page = Downloader::fetch(url, validators, download_limits);
+        if (concurrency) concurrency->finished(page);
+        frontier->release(url);
+
+        // A transient failure is fetched again later; the URL stays in flight until then
+        if (retries && retries->retry(page)) continue;
+        if (checkUnchanged(page)) continue;
+
+        if (page.error == CURLE_OK && !page.body.empty()) {
+            processPage(std::move(page));
+        } else {
+            if (page.abort_reason != AbortReason::None) {
+                std::cout << "Skipped: " << url << " (" << Downloader::abortReasonName(page.abort_reason) << ")" << std::endl;
             } else {
                 std::cout << "Failed to download: " << url << std::endl;
             }
-        } else {
-            // No URLs available, sleep briefly
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            frontier->complete(url);
         }
     }
-}
\ No newline at end of file
+}
+
+void WebCrawler::crawlEventDriven() {
+    // One event loop thread drives all transfers; the thread pool only parses
+    MultiDownloader engine(options.max_in_flight);
+    engine.start();
+
+    std::mutex progress_mutex;
+    std::condition_variable progress;
+    std::atomic<int> outstanding{0};    // Submitted but not yet fully processed
+
+    // Notified under the lock: once the teardown wait below sees the last
+    // task finish, no task may still be touching these locals
+    auto finish = [&]() {
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        outstanding.fetch_sub(1);
+        progress.notify_one();
+    };
+
+    while (!should_stop.load()) {
+        bool within_budget = options.max_pages == -1 ||
+            downloaded_count.load() + outstanding.load() < options.max_pages;
+
+        std::string url;
+        std::chrono::milliseconds wait{0};
+        if (outstanding.load() < options.max_in_flight && within_budget && frontier->tryPop(url, &wait)) {
+            std::cout << "Downloading: " << url << std::endl;
+            outstanding.fetch_add(1);
+            Validators validators;
+            if (recrawl_cache) recrawl_cache->lookup(url, validators);
+            if (concurrency) concurrency->started(url);
+            engine.submit(url, [this, &finish](DownloadResult&& result) {
+                if (concurrency) concurrency->finished(result);
+                frontier->release(result.url);
+                auto page = std::make_shared<DownloadResult>(std::move(result));
+                thread_pool->enqueue([this, page, &finish]() {
+                    if (this->retries && this->retries->retry(*page)) {
+                        // Fetched again once its backoff has passed
+                    } else if (this->checkUnchanged(*page)) {
+                        // The stored copy is current
+                    } else if (page->error == CURLE_OK && !page->body.empty()) {
+                        this->processPage(std::move(*page));
+                    } else {
+                        if (page->abort_reason != AbortReason::None) {
+                            std::cout << "Skipped: " << page->url << " ("
+                                      << Downloader::abortReasonName(page->abort_reason) << ")";
+                        } else {
+                            std::cout << "Failed to download: " << page->url;
+                            if (page->error != CURLE_OK) {
+                                std::cout << " (" << curl_easy_strerror(page->error) << ")";
+                            }
+                        }
+                        std::cout << std::endl;
+                        frontier->complete(page->url);
+                    }
+                    finish();
+                });
+            }, validators, download_limits);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(progress_mutex);
+        // finished() also counts URLs waiting for a retry
+        if (outstanding.load() == 0 && frontier->finished()) {
+            break; // Nothing in flight and nothing left to fetch
+        }
+        auto nap = std::chrono::milliseconds(100);
+        if (wait.count() > 0 && wait < nap) nap = wait;
+        progress.wait_for(lock, nap);
+    }
+
+    // Let transfers already in flight finish before tearing down the engine
+    std::unique_lock<std::mutex> lock(progress_mutex);
+    progress.wait(lock, [&]() { return outstanding.load() == 0; });
+    lock.unlock();
+    engine.stop();
+}
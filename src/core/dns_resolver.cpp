@@ -0,0 +1,265 @@
+#include "dns_resolver.h"
+#include "url_view.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+// Failed hosts are left to curl for a while before they are tried again
+constexpr std::chrono::seconds kFailureRetry(30);
+
+std::string lowercase(std::string_view text) {
+    std::string out(text);
+    for (char& c : out) {
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+    }
+    return out;
+}
+
+bool isAddress(const std::string& text) {
+    unsigned char buffer[sizeof(in6_addr)];
+    return inet_pton(AF_INET, text.c_str(), buffer) == 1 || inet_pton(AF_INET6, text.c_str(), buffer) == 1;
+}
+
+// Host and port of an http(s) URL; false for other URLs and IP literals
+bool hostAndPort(const std::string& url, std::string& host, std::string& port) {
+    UrlView view(url);
+    if (!view.isHttp() || view.host().empty() || view.host().front() == '[') return false;
+    host = lowercase(view.host());
+    if (isAddress(host)) return false;
+    if (!view.port().empty()) {
+        port = std::string(view.port());
+    } else {
+        port = view.schemeIs("https") ? "443" : "80";
+    }
+    return true;
+}
+
+uint64_t elapsedUs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+DnsResolver::DnsResolver(size_t thread_count, std::chrono::seconds ttl) : ttl(ttl) {
+    for (size_t i = 0; i < std::max<size_t>(1, thread_count); ++i) {
+        threads.emplace_back([this]() { this->resolverLoop(); });
+    }
+}
+
+DnsResolver::~DnsResolver() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    resolved.notify_all();
+    // A thread inside getaddrinfo finishes that lookup first
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+bool DnsResolver::loadHostsFile(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open()) return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string address, name;
+        if (!(fields >> address) || !isAddress(address)) continue;
+        if (address.find(':') != std::string::npos) address = "[" + address + "]";
+        while (fields >> name) {
+            std::string& addresses = pinned[lowercase(name)];
+            if (!addresses.empty()) addresses += ",";
+            addresses += address;
+        }
+    }
+    return true;
+}
+
+void DnsResolver::enqueue(const std::string& key, Entry& entry) {
+    entry.pending = true;
+    entry.queued = true;
+    queue.push_back(key);
+    work_ready.notify_one();
+}
+
+void DnsResolver::prefetch(const std::vector<std::string>& urls) {
+    // Links mostly share a few hosts; collect those before taking the lock
+    std::vector<std::pair<std::string, std::string>> hosts;
+    std::string host, port;
+    for (const auto& url : urls) {
+        if (!hostAndPort(url, host, port)) continue;
+        if (std::find(hosts.begin(), hosts.end(), std::make_pair(host, port)) == hosts.end()) {
+            hosts.emplace_back(host, port);
+        }
+    }
+    if (hosts.empty()) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = Clock::now();
+    for (auto& item : hosts) {
+        if (pinned.count(item.first)) continue;
+        std::string key = item.first + ":" + item.second;
+        Entry& entry = entries[key];
+        if (entry.pending || now < entry.expires) continue;
+        entry.host = std::move(item.first);
+        entry.port = std::move(item.second);
+        enqueue(key, entry);
+    }
+}
+
+curl_slist* DnsResolver::lookup(const std::string& url, bool wait) {
+    std::string host, port;
+    if (!hostAndPort(url, host, port)) return nullptr;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    stats.lookups++;
+    auto pin = pinned.find(host);
+    if (pin != pinned.end()) {
+        stats.hits++;
+        return entryList(host, port, pin->second);
+    }
+
+    std::string key = host + ":" + port;
+    Entry& entry = entries[key];
+    if (entry.host.empty()) {
+        entry.host = host;
+        entry.port = port;
+    }
+    auto now = Clock::now();
+    if (!entry.addresses.empty()) {
+        // Refreshed ahead of expiry; an expired entry is served until the refresh lands
+        if (!entry.pending && now >= entry.expires - ttl / 4) enqueue(key, entry);
+        stats.hits++;
+        return entryList(host, port, entry.addresses);
+    }
+
+    // Failed recently, or unresolved and the caller cannot wait: curl resolves it
+    if (!entry.pending && now < entry.expires) {
+        stats.misses++;
+        return nullptr;
+    }
+    if (!wait) {
+        if (!entry.pending) enqueue(key, entry);
+        stats.misses++;
+        return nullptr;
+    }
+
+    auto start = Clock::now();
+    if (entry.pending && !entry.queued) {
+        // Being resolved right now
+        stats.waits++;
+        resolved.wait(lock, [&]() { return stopping || !entries[key].pending; });
+    } else {
+        // Not started yet, or not asked for at all: resolve it here rather
+        // than wait behind the queue
+        stats.misses++;
+        entry.pending = true;
+        entry.queued = false;
+        resolve(key, lock);
+    }
+    stats.wait_us += elapsedUs(start);
+
+    const Entry& done = entries[key];
+    return done.addresses.empty() ? nullptr : entryList(host, port, done.addresses);
+}
+
+void DnsResolver::resolve(const std::string& key, std::unique_lock<std::mutex>& lock) {
+    std::string host = entries[key].host;
+    std::string port = entries[key].port;
+    bool refresh = !entries[key].addresses.empty();
+    lock.unlock();
+
+    auto start = Clock::now();
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &found);
+
+    std::string addresses;
+    for (addrinfo* info = rc == 0 ? found : nullptr; info; info = info->ai_next) {
+        char text[INET6_ADDRSTRLEN];
+        const void* address = info->ai_family == AF_INET6
+            ? static_cast<const void*>(&reinterpret_cast<sockaddr_in6*>(info->ai_addr)->sin6_addr)
+            : static_cast<const void*>(&reinterpret_cast<sockaddr_in*>(info->ai_addr)->sin_addr);
+        if (!inet_ntop(info->ai_family, address, text, sizeof(text))) continue;
+        std::string item = info->ai_family == AF_INET6 ? "[" + std::string(text) + "]" : std::string(text);
+        // getaddrinfo repeats an address for every protocol it supports
+        if (("," + addresses + ",").find("," + item + ",") != std::string::npos) continue;
+        if (!addresses.empty()) addresses += ",";
+        addresses += item;
+    }
+    if (found) freeaddrinfo(found);
+    uint64_t us = elapsedUs(start);
+    if (addresses.empty()) {
+        std::cerr << "DNS lookup failed for " << host << ": " << (rc != 0 ? gai_strerror(rc) : "no addresses")
+                  << std::endl;
+    }
+
+    lock.lock();
+    Entry& entry = entries[key];
+    stats.resolutions++;
+    if (refresh) stats.refreshes++;
+    stats.resolve_us += us;
+    stats.max_resolve_us = std::max(stats.max_resolve_us, us);
+    if (!addresses.empty()) {
+        entry.addresses = std::move(addresses);
+        entry.expires = Clock::now() + ttl;
+    } else {
+        // Old addresses, if any, stay in use until a retry succeeds
+        stats.failures++;
+        entry.expires = Clock::now() + kFailureRetry;
+    }
+    entry.pending = false;
+    resolved.notify_all();
+}
+
+void DnsResolver::resolverLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_ready.wait(lock, [&]() { return stopping || !queue.empty(); });
+        if (stopping) break;
+        std::string key = std::move(queue.front());
+        queue.pop_front();
+        Entry& entry = entries[key];
+        if (!entry.queued) continue;    // Taken over by a waiting transfer
+        entry.queued = false;
+        resolve(key, lock);
+    }
+}
+
+curl_slist* DnsResolver::entryList(const std::string& host, const std::string& port, const std::string& addresses) {
+    return curl_slist_append(nullptr, (host + ":" + port + ":" + addresses).c_str());
+}
+
+DnsResolver::Stats DnsResolver::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void DnsResolver::printStats() const {
+    Stats s = getStats();
+    std::cout << "DNS: " << s.lookups << " lookups";
+    if (s.lookups > 0) {
+        std::cout << ", " << s.hits * 100 / s.lookups << "% cache hits (" << s.waits << " waited for a prefetch, "
+                  << s.misses << " missed)";
+    }
+    std::cout << ", " << s.resolutions << " resolutions";
+    if (s.resolutions > 0) {
+        std::cout << " (" << s.refreshes << " refreshes) averaging " << s.resolve_us / s.resolutions / 1000.0
+                  << " ms, max " << s.max_resolve_us / 1000.0 << " ms";
+    }
+    if (s.failures > 0) std::cout << ", " << s.failures << " failed";
+    std::cout << ", transfers waited " << s.wait_us / 1000 << " ms" << std::endl;
+}
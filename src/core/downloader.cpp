@@ -1,36 +1,354 @@
 #include "downloader.h"
+#include "dns_resolver.h"
 #include <curl/curl.h>
 #include <iostream>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
 
-static size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* data) {
+namespace {
+
+// Shared DNS cache and TLS session cache for every handle in the pool.
+// libcurl does not support sharing one connection cache between concurrently
+// running threads, so live connections stay with the easy handle that opened
+// them; handles are recycled instead of destroyed, which keeps them alive.
+class CurlHandlePool {
+private:
+    CURLSH* share = nullptr;
+    std::mutex share_locks[CURL_LOCK_DATA_LAST];
+    std::mutex pool_mutex;
+    std::vector<CURL*> idle_handles;
+
+    static void lockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+        static_cast<CurlHandlePool*>(userptr)->share_locks[data].lock();
+    }
+
+    static void unlockShare(CURL*, curl_lock_data data, void* userptr) {
+        static_cast<CurlHandlePool*>(userptr)->share_locks[data].unlock();
+    }
+
+public:
+    std::atomic<uint64_t> handles_created{0};
+    std::atomic<uint64_t> new_connections{0};
+    std::atomic<uint64_t> reused_connections{0};
+    std::atomic<uint64_t> wire_bytes{0};
+    std::atomic<uint64_t> decoded_bytes{0};
+    std::atomic<uint64_t> encoded_responses{0};
+    std::atomic<uint64_t> aborted_content_type{0};
+    std::atomic<uint64_t> aborted_content_length{0};
+    std::atomic<uint64_t> aborted_body_size{0};
+
+    CURL* acquire() {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            if (!share) {
+                share = curl_share_init();
+                curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockShare);
+                curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+                curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+                curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+                curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+            }
+            if (!idle_handles.empty()) {
+                CURL* curl = idle_handles.back();
+                idle_handles.pop_back();
+                // Reset options only; connections, DNS and sessions survive
+                curl_easy_reset(curl);
+                curl_easy_setopt(curl, CURLOPT_SHARE, share);
+                return curl;
+            }
+        }
+
+        CURL* curl = curl_easy_init();
+        if (curl) {
+            handles_created.fetch_add(1);
+            curl_easy_setopt(curl, CURLOPT_SHARE, share);
+        }
+        return curl;
+    }
+
+    void release(CURL* curl) {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        idle_handles.push_back(curl);
+    }
+
+    void cleanup() {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        for (CURL* curl : idle_handles) {
+            curl_easy_cleanup(curl);
+        }
+        idle_handles.clear();
+        if (share) {
+            curl_share_cleanup(share);
+            share = nullptr;
+        }
+    }
+};
+
+CurlHandlePool& handlePool() {
+    static CurlHandlePool pool;
+    return pool;
+}
+
+std::atomic<DnsResolver*> resolver{nullptr};
+
+constexpr uint64_t kMaxReserveBytes = 16 * 1024 * 1024;
+
+std::string lowerTrimmed(const std::string& value) {
+    size_t begin = value.find_first_not_of(" \t");
+    size_t end = value.find_last_not_of(" \t\r\n");
+    std::string out = begin == std::string::npos ? "" : value.substr(begin, end - begin + 1);
+    for (char& c : out) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return out;
+}
+
+// Decides on a response once its headers are complete. Returns false to abort.
+bool acceptResponse(TransferContext* context) {
+    // Redirects and interim responses are not the page itself; 304 has no body
+    long code = context->response_code;
+    if ((code >= 100 && code < 200) || (code >= 300 && code < 400)) return true;
+
+    std::string content_type;
+    long long content_length = -1;
+    std::istringstream lines(context->result->headers);
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = lowerTrimmed(line.substr(0, colon));
+        if (name == "content-type") {
+            content_type = lowerTrimmed(line.substr(colon + 1));
+        } else if (name == "content-length") {
+            content_length = std::atoll(line.c_str() + colon + 1);
+        }
+    }
+
+    const DownloadLimits& limits = context->limits;
+    if (limits.html_only && !content_type.empty()) {
+        std::string media_type = lowerTrimmed(content_type.substr(0, content_type.find(';')));
+        if (media_type != "text/html" && media_type != "application/xhtml+xml") {
+            context->result->abort_reason = AbortReason::ContentType;
+            return false;
+        }
+    }
+    if (content_length > 0) {
+        if (limits.max_body_bytes > 0 && static_cast<uint64_t>(content_length) > limits.max_body_bytes) {
+            context->result->abort_reason = AbortReason::ContentLength;
+            return false;
+        }
+        // The declared length is the encoded size, so this is only a first guess
+        if (!context->sink) context->result->body.reserve(std::min<uint64_t>(content_length, kMaxReserveBytes));
+    }
+    return true;
+}
+
+} // namespace
+
+static size_t WriteCallback(void* contents, size_t size, size_t nmemb, TransferContext* context) {
     size_t total_size = size * nmemb;
-    data->append((char*)contents, total_size);
+    DownloadResult* result = context->result;
+    // Counts decoded bytes, so a small compressed response cannot expand without bound
+    if (context->limits.max_body_bytes > 0 && result->body_bytes + total_size > context->limits.max_body_bytes) {
+        result->abort_reason = AbortReason::BodySize;
+        return 0;
+    }
+    result->body_bytes += total_size;
+    if (context->sink) return (*context->sink)(static_cast<char*>(contents), total_size) ? total_size : 0;
+    result->body.append(static_cast<char*>(contents), total_size);
+    return total_size;
+}
+
+static size_t HeaderCallback(char* buffer, size_t size, size_t nitems, TransferContext* context) {
+    size_t total_size = size * nitems;
+    std::string& headers = context->result->headers;
+    // Redirects produce several responses; keep only the last one's headers
+    if (total_size >= 5 && std::char_traits<char>::compare(buffer, "HTTP/", 5) == 0) {
+        headers.clear();
+        const char* space = static_cast<const char*>(std::memchr(buffer, ' ', total_size));
+        context->response_code = space ? std::atol(space + 1) : 0;
+    }
+    headers.append(buffer, total_size);
+
+    // An empty line ends the header block
+    bool end_of_headers = (total_size == 2 && buffer[0] == '\r' && buffer[1] == '\n') ||
+                          (total_size == 1 && buffer[0] == '\n');
+    if (end_of_headers && !acceptResponse(context)) return 0;
     return total_size;
 }
 
+void Downloader::configureHandle(CURL* curl, TransferContext* context) {
+    curl_easy_setopt(curl, CURLOPT_URL, context->result->url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, context);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, context);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, ""); // Offer every built-in content encoding
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L); // Increased timeout
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0 (WebCrawler/1.0)");
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L); // For HTTPS issues
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L); // Required for multithreaded use
+}
+
+curl_slist* Downloader::conditionalHeaders(const Validators& validators) {
+    curl_slist* list = nullptr;
+    if (!validators.etag.empty()) {
+        list = curl_slist_append(list, ("If-None-Match: " + validators.etag).c_str());
+    }
+    if (!validators.last_modified.empty()) {
+        list = curl_slist_append(list, ("If-Modified-Since: " + validators.last_modified).c_str());
+    }
+    return list;
+}
+
+void Downloader::setResolver(DnsResolver* dns_resolver) {
+    resolver.store(dns_resolver);
+}
+
+curl_slist* Downloader::resolveEntries(const std::string& url, bool wait) {
+    DnsResolver* dns_resolver = resolver.load();
+    return dns_resolver ? dns_resolver->lookup(url, wait) : nullptr;
+}
+
+const char* Downloader::abortReasonName(AbortReason reason) {
+    switch (reason) {
+        case AbortReason::ContentType: return "not HTML";
+        case AbortReason::ContentLength: return "declared size over the limit";
+        case AbortReason::BodySize: return "body over the size limit";
+        default: return "not aborted";
+    }
+}
+
+void Downloader::recordTransfer(CURL* curl, const DownloadResult& result) {
+    CurlHandlePool& pool = handlePool();
+    uint64_t decoded_bytes = result.body_bytes;
+
+    switch (result.abort_reason) {
+        case AbortReason::ContentType: pool.aborted_content_type.fetch_add(1); break;
+        case AbortReason::ContentLength: pool.aborted_content_length.fetch_add(1); break;
+        case AbortReason::BodySize: pool.aborted_body_size.fetch_add(1); break;
+        default: break;
+    }
+
+    // SIZE_DOWNLOAD counts body bytes before content decoding
+    curl_off_t wire_bytes = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &wire_bytes) == CURLE_OK && wire_bytes > 0) {
+        pool.wire_bytes.fetch_add(static_cast<uint64_t>(wire_bytes));
+        if (static_cast<uint64_t>(wire_bytes) != decoded_bytes) pool.encoded_responses.fetch_add(1);
+    }
+    pool.decoded_bytes.fetch_add(decoded_bytes);
+
+    // NUM_CONNECTS is 0 when the transfer ran on a kept-alive connection
+    long num_connects = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &num_connects);
+    if (num_connects > 0) {
+        pool.new_connections.fetch_add(num_connects);
+    } else if (result.error == CURLE_OK) {
+        pool.reused_connections.fetch_add(1);
+    }
+}
+
 std::string Downloader::download(const std::string& url) {
-    CURL* curl = curl_easy_init();
-    std::string response;
-    
+    return fetch(url).body;
+}
+
+DownloadResult Downloader::fetch(const std::string& url, const Validators& validators, const DownloadLimits& limits) {
+    return perform(url, validators, limits, nullptr);
+}
+
+DownloadResult Downloader::stream(const std::string& url, const BodySink& sink, const DownloadLimits& limits) {
+    return perform(url, Validators(), limits, &sink);
+}
+
+DownloadResult Downloader::perform(const std::string& url, const Validators& validators,
+                                   const DownloadLimits& limits, const BodySink* sink) {
+    CurlHandlePool& pool = handlePool();
+    CURL* curl = pool.acquire();
+    DownloadResult result;
+    result.url = url;
+
     if (curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L); // Increased timeout
-        curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0 (WebCrawler/1.0)");
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L); // For HTTPS issues
-        
+        TransferContext context;
+        context.result = &result;
+        context.limits = limits;
+        context.sink = sink;
+        configureHandle(curl, &context);
+        curl_slist* request_headers = conditionalHeaders(validators);
+        if (request_headers) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request_headers);
+        curl_slist* resolve = resolveEntries(url, true);
+        if (resolve) curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve);
+
         CURLcode res = curl_easy_perform(curl);
-        if (res != CURLE_OK) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, nullptr);
+        curl_easy_setopt(curl, CURLOPT_RESOLVE, nullptr);
+        curl_slist_free_all(request_headers);
+        curl_slist_free_all(resolve);
+        result.error = res;
+        result.fetch_time = std::chrono::system_clock::now();
+        // Kept for aborted transfers too: a 429 cut off as not HTML still asks to come back
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &result.status_code);
+        if (result.abort_reason == AbortReason::None && res != CURLE_OK) {
             std::cerr << "Failed to download " << url << ": " << curl_easy_strerror(res) << std::endl;
-        } else {
-            long response_code;
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-            //std::cout << "HTTP " << response_code << " for " << url << std::endl;
         }
-        
-        curl_easy_cleanup(curl);
+
+        recordTransfer(curl, result);
+        pool.release(curl);
+    } else {
+        result.error = CURLE_FAILED_INIT;
     }
-    return response;
-}
\ No newline at end of file
+    return result;
+}
+
+DownloadStats Downloader::getStats() {
+    CurlHandlePool& pool = handlePool();
+    DownloadStats stats;
+    stats.handles_created = pool.handles_created.load();
+    stats.new_connections = pool.new_connections.load();
+    stats.reused_connections = pool.reused_connections.load();
+    stats.wire_bytes = pool.wire_bytes.load();
+    stats.decoded_bytes = pool.decoded_bytes.load();
+    stats.encoded_responses = pool.encoded_responses.load();
+    stats.aborted_content_type = pool.aborted_content_type.load();
+    stats.aborted_content_length = pool.aborted_content_length.load();
+    stats.aborted_body_size = pool.aborted_body_size.load();
+    return stats;
+}
+
+void Downloader::printStats() {
+    DownloadStats stats = getStats();
+    uint64_t total = stats.new_connections + stats.reused_connections;
+    std::cout << "Connections: " << stats.new_connections << " new, "
+              << stats.reused_connections << " reused";
+    if (total > 0) {
+        std::cout << " (" << (100 * stats.reused_connections / total) << "% reuse)";
+    }
+    if (stats.handles_created > 0) {
+        std::cout << ", pooled handles: " << stats.handles_created;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Transfer: " << stats.wire_bytes / 1024 << " KB on the wire, "
+              << stats.decoded_bytes / 1024 << " KB decoded";
+    if (stats.wire_bytes > 0 && stats.decoded_bytes > stats.wire_bytes) {
+        std::cout << " (" << stats.decoded_bytes * 10 / stats.wire_bytes / 10.0 << "x, "
+                  << stats.encoded_responses << " content-encoded responses)";
+    }
+    std::cout << std::endl;
+
+    uint64_t aborted = stats.aborted_content_type + stats.aborted_content_length + stats.aborted_body_size;
+    if (aborted > 0) {
+        std::cout << "Aborted early: " << aborted << " responses (" << stats.aborted_content_type << " not HTML, "
+                  << stats.aborted_content_length << " declared too large, " << stats.aborted_body_size
+                  << " body too large)" << std::endl;
+    }
+}
+
+void Downloader::cleanup() {
+    handlePool().cleanup();
+}
@@ -0,0 +1,488 @@
+#include "frontier.h"
+#include "url_view.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+
+namespace {
+constexpr size_t kRefillBatch = 4096;
+constexpr size_t kTypicalEntryCost = 128;
+
+// Scores from kTopScore down fall into kBands bands one point wide; the
+// first and last band also take everything above and below
+constexpr int kBands = 16;
+constexpr double kTopScore = 8.0;
+constexpr size_t kBandHeapCapacity = 1024;
+constexpr size_t kRescoreInterval = 256;
+
+// Spilled and checkpointed URLs keep their depth as "<depth> <url>".
+// Canonical URLs never contain a space and start with a letter.
+std::string packEntry(int depth, const std::string& url) {
+    return std::to_string(depth) + ' ' + url;
+}
+
+void unpackEntry(std::string& record, int& depth) {
+    depth = 0;
+    if (record.empty() || record[0] < '0' || record[0] > '9') return;
+    size_t space = record.find(' ');
+    if (space == std::string::npos) return;
+    depth = std::atoi(record.c_str());
+    record.erase(0, space + 1);
+}
+
+} // namespace
+
+Frontier::Frontier(std::chrono::milliseconds min_delay, int max_per_host,
+                   size_t memory_limit, const std::string& spill_dir, size_t num_shards)
+    : min_delay(min_delay), max_per_host(max_per_host), memory_limit(memory_limit), spill_dir(spill_dir) {
+    for (size_t i = 0; i < std::max<size_t>(1, num_shards); ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+    if (memory_limit > 0) {
+        spill = std::make_unique<SpillQueue>(spill_dir);
+    }
+}
+
+std::string Frontier::hostKey(const std::string& url) {
+    return std::string(UrlView(url).origin());
+}
+
+void Frontier::setScorer(Scorer scorer, bool rescore) {
+    this->scorer = std::move(scorer);
+    this->rescore = rescore && this->scorer;
+}
+
+int Frontier::bandOf(double score) {
+    double band = std::floor(kTopScore - score);
+    return static_cast<int>(std::min<double>(kBands - 1, std::max(0.0, band)));
+}
+
+Frontier::Entry Frontier::makeEntry(std::string url, int depth) {
+    double score = scorer ? scorer(url, depth) : 0.0;
+    return Entry{std::move(url), score, next_seq++, depth};
+}
+
+void Frontier::setHostDelay(const std::string& host, std::chrono::milliseconds delay) {
+    Shard& shard = shardFor(host);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.hosts[host].delay = delay;
+}
+
+void Frontier::setHostLimit(const std::string& host, int limit) {
+    Shard& shard = shardFor(host);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    HostQueue& hq = shard.hosts[host];
+    hq.limit = std::max(0, limit);
+    // A raised limit may let the host's queued URLs go now
+    if (canSchedule(hq)) {
+        schedule(shard, host, hq);
+        lock.unlock();
+        notifyWaiters();
+    }
+}
+
+Frontier::Shard& Frontier::shardFor(const std::string& host) const {
+    return *shards[std::hash<std::string>{}(host) % shards.size()];
+}
+
+void Frontier::schedule(Shard& shard, const std::string& host, HostQueue& hq) {
+    shard.ready.push(ReadyEntry{hq.next_allowed, host});
+    hq.in_heap = true;
+}
+
+void Frontier::enqueue(Shard& shard, const std::string& host, Entry entry) {
+    memory_used += entryCost(entry.url);
+
+    HostQueue& hq = shard.hosts[host];
+    place(hq, std::move(entry));
+    hq.count++;
+    queued++;
+    if (canSchedule(hq)) {
+        schedule(shard, host, hq);
+    }
+}
+
+void Frontier::place(HostQueue& hq, Entry entry) {
+    Band& band = hq.bands[bandOf(entry.score)];
+    // Once a band overflows, newcomers queue behind the overflow
+    if (band.heap.size() < kBandHeapCapacity && band.overflow.empty()) {
+        band.heap.push_back(std::move(entry));
+        std::push_heap(band.heap.begin(), band.heap.end(), Lower());
+    } else {
+        band.overflow.push_back(std::move(entry));
+    }
+}
+
+Frontier::Entry Frontier::takeBest(HostQueue& hq) {
+    auto it = hq.bands.begin();
+    if (rescore && ++it->second.pops >= kRescoreInterval) {
+        rescoreBand(hq, it->first);
+        it = hq.bands.begin();     // URLs may have moved to a better band
+    }
+    Band& band = it->second;
+
+    std::pop_heap(band.heap.begin(), band.heap.end(), Lower());
+    Entry best = std::move(band.heap.back());
+    band.heap.pop_back();
+    hq.count--;
+
+    // Keep the heap full from the overflow, rescoring what moves in
+    while (band.heap.size() < kBandHeapCapacity && !band.overflow.empty()) {
+        Entry next = std::move(band.overflow.front());
+        band.overflow.pop_front();
+        if (rescore) next.score = scorer(next.url, next.depth);
+        int target = bandOf(next.score);
+        if (target == it->first) {
+            band.heap.push_back(std::move(next));
+            std::push_heap(band.heap.begin(), band.heap.end(), Lower());
+        } else {
+            place(hq, std::move(next));
+        }
+    }
+    if (band.heap.empty() && band.overflow.empty()) hq.bands.erase(it);
+    return best;
+}
+
+void Frontier::rescoreBand(HostQueue& hq, int band_index) {
+    Band& band = hq.bands[band_index];
+    band.pops = 0;
+    std::vector<Entry> moved;
+    size_t kept = 0;
+    for (size_t i = 0; i < band.heap.size(); ++i) {
+        Entry& entry = band.heap[i];
+        entry.score = scorer(entry.url, entry.depth);
+        if (bandOf(entry.score) != band_index) {
+            moved.push_back(std::move(entry));
+        } else if (kept++ != i) {
+            band.heap[kept - 1] = std::move(entry);
+        }
+    }
+    band.heap.resize(kept);
+    std::make_heap(band.heap.begin(), band.heap.end(), Lower());
+    for (auto& entry : moved) place(hq, std::move(entry));
+    // Every band keeps a non-empty heap; the next pop refills the rest
+    if (band.heap.empty() && !band.overflow.empty()) {
+        band.heap.push_back(std::move(band.overflow.front()));
+        band.overflow.pop_front();
+    }
+    if (band.heap.empty()) hq.bands.erase(band_index);
+}
+
+void Frontier::enqueueBatch(std::vector<Entry>& entries) {
+    // Group by shard so each lock is taken once per batch
+    std::vector<std::string> hosts(entries.size());
+    std::vector<std::vector<size_t>> groups(shards.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        hosts[i] = hostKey(entries[i].url);
+        groups[std::hash<std::string>{}(hosts[i]) % shards.size()].push_back(i);
+    }
+
+    for (size_t s = 0; s < groups.size(); ++s) {
+        if (groups[s].empty()) continue;
+        Shard& shard = *shards[s];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (size_t i : groups[s]) {
+            enqueue(shard, hosts[i], std::move(entries[i]));
+        }
+    }
+}
+
+bool Frontier::shouldSpill(size_t extra) const {
+    // Once spilling has started, keep appending to disk so order is preserved
+    return spill && (spill_pending.load() || (memory_limit > 0 && memory_used.load() + extra > memory_limit));
+}
+
+void Frontier::refillFromDisk() {
+    std::unique_lock<std::mutex> lock(spill_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) return;  // Another worker is already refilling
+
+    // Refill up to three quarters of the limit, leaving room for new links.
+    // Without a limit (a resumed crawl may have spilled segments) use one batch.
+    size_t target = memory_limit > 0 ? memory_limit / 4 * 3 : memory_used.load() + kRefillBatch * kTypicalEntryCost;
+    std::vector<std::string> batch;
+    std::vector<Entry> entries;
+    while (!spill->empty() && memory_used.load() < target) {
+        size_t wanted = std::min(kRefillBatch, (target - memory_used.load()) / kTypicalEntryCost + 1);
+        batch.clear();
+        if (spill->popBatch(batch, wanted) == 0) break;
+        entries.clear();
+        for (auto& record : batch) {
+            int depth = 0;
+            unpackEntry(record, depth);
+            entries.push_back(makeEntry(std::move(record), depth));
+        }
+        enqueueBatch(entries);
+    }
+    spill_pending = !spill->empty();
+    lock.unlock();
+    notifyWaiters();
+}
+
+void Frontier::push(const std::string& url, int depth) {
+    pushBatch(std::vector<std::string>{url}, depth);
+}
+
+void Frontier::pushBatch(std::vector<std::string> urls, int depth) {
+    // Scored here, before any lock is taken
+    std::vector<Entry> entries;
+    entries.reserve(urls.size());
+    for (auto& url : urls) {
+        entries.push_back(makeEntry(std::move(url), depth));
+    }
+    pushEntries(std::move(entries));
+}
+
+void Frontier::pushEntries(std::vector<Entry> entries) {
+    size_t kept = entries.size();
+    size_t batch_cost = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        batch_cost += entryCost(entries[i].url);
+        if (shouldSpill(batch_cost)) {
+            kept = i;
+            break;
+        }
+    }
+
+    if (kept < entries.size()) {
+        std::lock_guard<std::mutex> lock(spill_mutex);
+        for (size_t i = kept; i < entries.size(); ++i) {
+            spill->push(packEntry(entries[i].depth, entries[i].url));
+        }
+        spill_pending = true;
+        entries.resize(kept);
+    }
+    enqueueBatch(entries);
+    notifyWaiters();
+}
+
+bool Frontier::popFrom(Shard& shard, Clock::time_point now, std::string& url, Clock::time_point& next_ready) {
+    while (!shard.ready.empty()) {
+        const ReadyEntry& top = shard.ready.top();
+        if (top.ready_at > now) {
+            next_ready = std::min(next_ready, top.ready_at);
+            return false;
+        }
+
+        std::string host = top.host;
+        shard.ready.pop();
+        HostQueue& hq = shard.hosts[host];
+        hq.in_heap = false;
+
+        // The host's delay may have been pushed back since it was scheduled
+        if (hq.next_allowed > now) {
+            if (canSchedule(hq)) schedule(shard, host, hq);
+            continue;
+        }
+        if (hq.count == 0) continue;
+
+        Entry entry = takeBest(hq);
+        url = std::move(entry.url);
+        // Counted in flight before leaving the queue so finished() never sees a gap
+        in_flight++;
+        queued--;
+        memory_used -= std::min(memory_used.load(), entryCost(url));
+        hq.active++;
+        hq.next_allowed = now + delayFor(hq);
+        shard.in_progress.emplace(url, entry.depth);
+        if (canSchedule(hq)) {
+            schedule(shard, host, hq);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool Frontier::tryPop(std::string& url, std::chrono::milliseconds* wait) {
+    if (spill && spill_pending.load() && (memory_used.load() < memory_limit / 2 || queued.load() == 0)) {
+        refillFromDisk();
+    }
+
+    Clock::time_point now = Clock::now();
+    Clock::time_point next_ready = Clock::time_point::max();
+
+    // Start at a different shard on each call so workers spread over them
+    size_t start = next_shard.fetch_add(1);
+    for (size_t i = 0; i < shards.size(); ++i) {
+        Shard& shard = *shards[(start + i) % shards.size()];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (popFrom(shard, now, url, next_ready)) return true;
+    }
+
+    if (wait) {
+        *wait = next_ready == Clock::time_point::max() ? std::chrono::milliseconds(0) :
+                std::chrono::duration_cast<std::chrono::milliseconds>(next_ready - now) + std::chrono::milliseconds(1);
+    }
+    return false;
+}
+
+void Frontier::release(const std::string& url) {
+    std::string host = hostKey(url);
+    Shard& shard = shardFor(host);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    auto it = shard.hosts.find(host);
+    if (it == shard.hosts.end()) return;
+
+    HostQueue& hq = it->second;
+    hq.active = std::max(0, hq.active - 1);
+    // Politeness delay counts from the end of the previous fetch
+    hq.next_allowed = std::max(hq.next_allowed, Clock::now() + delayFor(hq));
+    if (canSchedule(hq)) {
+        schedule(shard, host, hq);
+    }
+    lock.unlock();
+    notifyWaiters();
+}
+
+void Frontier::complete(const std::string& url) {
+    Shard& shard = shardFor(hostKey(url));
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.in_progress.erase(url)) in_flight--;
+    }
+    notifyWaiters();
+}
+
+void Frontier::requeue(const std::string& url) {
+    std::string host = hostKey(url);
+    // Scored before the lock is taken, like a push
+    Entry entry = makeEntry(url, depthOf(url));
+    Shard& shard = shardFor(host);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // Queued before it leaves in_progress so finished() never sees a gap
+        enqueue(shard, host, std::move(entry));
+        if (shard.in_progress.erase(url)) in_flight--;
+    }
+    notifyWaiters();
+}
+
+int Frontier::depthOf(const std::string& url) const {
+    Shard& shard = shardFor(hostKey(url));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.in_progress.find(url);
+    return it == shard.in_progress.end() ? 0 : it->second;
+}
+
+void Frontier::notifyWaiters() {
+    generation++;
+    // Waiters register before re-checking the generation, so skipping the
+    // lock when nobody is registered cannot lose a wake-up
+    if (waiters.load() > 0) {
+        std::lock_guard<std::mutex> lock(wait_mutex);
+        work_available.notify_all();
+    }
+}
+
+bool Frontier::waitPop(std::string& url) {
+    while (!closed.load()) {
+        uint64_t seen = generation.load();
+        std::chrono::milliseconds wait{0};
+        if (tryPop(url, &wait)) return true;
+        if (finished()) return false;
+
+        std::unique_lock<std::mutex> lock(wait_mutex);
+        waiters++;
+        auto changed = [&]() { return closed.load() || generation.load() != seen; };
+        if (wait.count() > 0) {
+            // A host becomes eligible at a known time even if nothing else happens
+            work_available.wait_for(lock, wait, changed);
+        } else {
+            work_available.wait(lock, changed);
+        }
+        waiters--;
+    }
+    return false;
+}
+
+void Frontier::close() {
+    closed = true;
+    std::lock_guard<std::mutex> lock(wait_mutex);
+    work_available.notify_all();
+}
+
+bool Frontier::empty() const {
+    return queued.load() == 0 && !spill_pending.load();
+}
+
+bool Frontier::finished() const {
+    return in_flight.load() == 0 && empty();
+}
+
+size_t Frontier::size() const {
+    std::lock_guard<std::mutex> lock(spill_mutex);
+    return queued.load() + (spill ? spill->size() : 0);
+}
+
+size_t Frontier::hostCount() const {
+    size_t count = 0;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        count += shard->hosts.size();
+    }
+    return count;
+}
+
+uint64_t Frontier::spilledCount() const {
+    std::lock_guard<std::mutex> lock(spill_mutex);
+    return spill ? spill->totalSpilled() : 0;
+}
+
+size_t Frontier::memoryUsage() const {
+    return memory_used.load();
+}
+
+void Frontier::snapshot(std::vector<std::string>& urls, SpillQueue::State& spill_state, size_t& retired_segments) {
+    // Lock order matches refillFromDisk(): spill first, then every shard
+    std::lock_guard<std::mutex> spill_lock(spill_mutex);
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (const auto& shard : shards) {
+        locks.emplace_back(shard->mutex);
+    }
+
+    urls.reserve(urls.size() + queued.load());
+    for (const auto& shard : shards) {
+        for (const auto& entry : shard->in_progress) {
+            urls.push_back(packEntry(entry.second, entry.first));
+        }
+        for (const auto& host : shard->hosts) {
+            for (const auto& band : host.second.bands) {
+                for (const auto& entry : band.second.heap) urls.push_back(packEntry(entry.depth, entry.url));
+                for (const auto& entry : band.second.overflow) urls.push_back(packEntry(entry.depth, entry.url));
+            }
+        }
+    }
+    retired_segments = 0;
+    spill_state = spill ? spill->snapshot(retired_segments) : SpillQueue::State{};
+}
+
+bool Frontier::restore(const std::vector<std::string>& urls, const SpillQueue::State& spill_state) {
+    {
+        std::lock_guard<std::mutex> lock(spill_mutex);
+        if (!spill_state.segments.empty()) {
+            if (!spill) spill = std::make_unique<SpillQueue>(spill_dir);
+            if (!spill->restore(spill_state)) return false;
+            spill_pending = !spill->empty();
+        }
+    }
+    std::vector<Entry> entries;
+    entries.reserve(urls.size());
+    for (std::string record : urls) {
+        int depth = 0;
+        unpackEntry(record, depth);
+        entries.push_back(makeEntry(std::move(record), depth));
+    }
+    pushEntries(std::move(entries));
+    return true;
+}
+
+void Frontier::releaseSpill(size_t retired_segments) {
+    std::lock_guard<std::mutex> lock(spill_mutex);
+    if (spill) spill->releaseRetired(retired_segments);
+}
+
+void Frontier::setRetainSpill(bool retain) {
+    std::lock_guard<std::mutex> lock(spill_mutex);
+    if (spill) spill->setRetainSegments(retain);
+}
@@ -0,0 +1,248 @@
+#include "multi_downloader.h"
+#include "downloader.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+
+namespace {
+
+// Marker stored with curl_multi_assign once a socket is registered with epoll
+int registered_socket_marker = 0;
+
+constexpr int kMaxEvents = 256;
+constexpr int kIdleWaitMs = 1000;
+
+using Clock = std::chrono::steady_clock;
+
+} // namespace
+
+MultiDownloader::MultiDownloader(long max_connections) {
+    multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, socketCallback);
+    curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, timerCallback);
+    curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+    if (max_connections > 0) {
+        curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, max_connections);
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0) {
+        std::cerr << "MultiDownloader: failed to create epoll/eventfd descriptors" << std::endl;
+        return;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+}
+
+MultiDownloader::~MultiDownloader() {
+    stop();
+
+    // Anything still queued or running is dropped without invoking callbacks
+    for (Transfer* transfer : pending) {
+        delete transfer;
+    }
+    pending.clear();
+    for (CURL* handle : idle_handles) {
+        curl_easy_cleanup(handle);
+    }
+    idle_handles.clear();
+
+    if (multi) curl_multi_cleanup(multi);
+    if (wake_fd >= 0) close(wake_fd);
+    if (epoll_fd >= 0) close(epoll_fd);
+}
+
+void MultiDownloader::start() {
+    if (running.exchange(true)) return;
+    loop_thread = std::thread([this]() { this->eventLoop(); });
+}
+
+void MultiDownloader::stop() {
+    if (!running.exchange(false)) return;
+    wake();
+    if (loop_thread.joinable()) {
+        loop_thread.join();
+    }
+}
+
+void MultiDownloader::submit(const std::string& url, DownloadCallback callback, const Validators& validators,
+                             const DownloadLimits& limits) {
+    Transfer* transfer = new Transfer();
+    transfer->result.url = url;
+    transfer->context.result = &transfer->result;
+    transfer->context.limits = limits;
+    transfer->callback = std::move(callback);
+    transfer->validators = validators;
+
+    in_flight.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending.push_back(transfer);
+    }
+    wake();
+}
+
+void MultiDownloader::wake() {
+    uint64_t one = 1;
+    ssize_t written = write(wake_fd, &one, sizeof(one));
+    (void)written; // EAGAIN only means a wake-up is already pending
+}
+
+int MultiDownloader::socketCallback(CURL*, curl_socket_t s, int what, void* userp, void* socketp) {
+    MultiDownloader* self = static_cast<MultiDownloader*>(userp);
+
+    if (what == CURL_POLL_REMOVE) {
+        if (socketp) {
+            epoll_ctl(self->epoll_fd, EPOLL_CTL_DEL, s, nullptr);
+            curl_multi_assign(self->multi, s, nullptr);
+        }
+        return 0;
+    }
+
+    epoll_event ev{};
+    ev.data.fd = s;
+    if (what == CURL_POLL_IN || what == CURL_POLL_INOUT) ev.events |= EPOLLIN;
+    if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT) ev.events |= EPOLLOUT;
+
+    if (socketp) {
+        epoll_ctl(self->epoll_fd, EPOLL_CTL_MOD, s, &ev);
+    } else {
+        epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, s, &ev);
+        curl_multi_assign(self->multi, s, &registered_socket_marker);
+    }
+    return 0;
+}
+
+int MultiDownloader::timerCallback(CURLM*, long timeout_ms, void* userp) {
+    MultiDownloader* self = static_cast<MultiDownloader*>(userp);
+    self->timer_armed = timeout_ms >= 0;
+    if (self->timer_armed) {
+        self->timer_deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+    }
+    return 0;
+}
+
+void MultiDownloader::addPendingTransfers() {
+    std::deque<Transfer*> batch;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        batch.swap(pending);
+    }
+
+    for (Transfer* transfer : batch) {
+        CURL* handle = nullptr;
+        if (!idle_handles.empty()) {
+            handle = idle_handles.back();
+            idle_handles.pop_back();
+            curl_easy_reset(handle);
+        } else {
+            handle = curl_easy_init();
+        }
+
+        if (!handle) {
+            transfer->result.error = CURLE_FAILED_INIT;
+            in_flight.fetch_sub(1);
+            transfer->callback(std::move(transfer->result));
+            delete transfer;
+            continue;
+        }
+
+        transfer->handle = handle;
+        Downloader::configureHandle(handle, &transfer->context);
+        transfer->request_headers = Downloader::conditionalHeaders(transfer->validators);
+        if (transfer->request_headers) curl_easy_setopt(handle, CURLOPT_HTTPHEADER, transfer->request_headers);
+        // The event loop must not block: a host not resolved yet is resolved by curl
+        transfer->resolve = Downloader::resolveEntries(transfer->result.url, false);
+        if (transfer->resolve) curl_easy_setopt(handle, CURLOPT_RESOLVE, transfer->resolve);
+        curl_easy_setopt(handle, CURLOPT_PRIVATE, transfer);
+        active.insert(transfer);
+        curl_multi_add_handle(multi, handle);
+    }
+}
+
+void MultiDownloader::checkCompleted() {
+    int msgs_left = 0;
+    CURLMsg* msg = nullptr;
+    while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+        if (msg->msg != CURLMSG_DONE) continue;
+
+        CURL* handle = msg->easy_handle;
+        CURLcode result = msg->data.result;
+        Transfer* transfer = nullptr;
+        curl_easy_getinfo(handle, CURLINFO_PRIVATE, &transfer);
+
+        transfer->result.error = result;
+        transfer->result.fetch_time = std::chrono::system_clock::now();
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &transfer->result.status_code);
+        Downloader::recordTransfer(handle, transfer->result);
+
+        curl_multi_remove_handle(multi, handle);
+        idle_handles.push_back(handle);
+        active.erase(transfer);
+
+        transfer->callback(std::move(transfer->result));
+        delete transfer;
+        in_flight.fetch_sub(1);
+    }
+}
+
+void MultiDownloader::eventLoop() {
+    epoll_event events[kMaxEvents];
+
+    while (running.load()) {
+        int wait_ms = kIdleWaitMs;
+        if (timer_armed) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(timer_deadline - Clock::now()).count();
+            wait_ms = remaining > 0 ? static_cast<int>(remaining) : 0;
+        }
+
+        int n = epoll_wait(epoll_fd, events, kMaxEvents, wait_ms);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "MultiDownloader: epoll_wait failed" << std::endl;
+            break;
+        }
+
+        int still_running = 0;
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.fd == wake_fd) {
+                uint64_t count;
+                ssize_t drained = read(wake_fd, &count, sizeof(count));
+                (void)drained;
+                addPendingTransfers();
+                continue;
+            }
+
+            int flags = 0;
+            if (events[i].events & EPOLLIN) flags |= CURL_CSELECT_IN;
+            if (events[i].events & EPOLLOUT) flags |= CURL_CSELECT_OUT;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) flags |= CURL_CSELECT_ERR;
+            curl_multi_socket_action(multi, events[i].data.fd, flags, &still_running);
+        }
+
+        if (timer_armed && Clock::now() >= timer_deadline) {
+            // One-shot: curl re-arms the timer through timerCallback if needed
+            timer_armed = false;
+            curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0, &still_running);
+        }
+
+        checkCompleted();
+    }
+
+    // Tear down transfers that were still running when the loop stopped
+    for (Transfer* transfer : active) {
+        curl_multi_remove_handle(multi, transfer->handle);
+        curl_easy_cleanup(transfer->handle);
+        delete transfer;
+        in_flight.fetch_sub(1);
+    }
+    active.clear();
+}
@@ -0,0 +1,269 @@
+#include "page_codec.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+#include <unordered_set>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kMinDictionaryBytes = 256;
+constexpr size_t kMinRunBytes = 8;
+constexpr size_t kMaxCandidates = 4096;
+
+// Cuts a page into pieces that end at a tag end or a line break
+std::vector<std::string_view> splitPieces(const std::string& page) {
+    std::vector<std::string_view> pieces;
+    size_t start = 0;
+    for (size_t i = 0; i < page.size(); ++i) {
+        if (page[i] == '>' || page[i] == '\n') {
+            pieces.emplace_back(page.data() + start, i + 1 - start);
+            start = i + 1;
+        }
+    }
+    if (start < page.size()) pieces.emplace_back(page.data() + start, page.size() - start);
+    return pieces;
+}
+
+} // namespace
+
+PageCodec::PageCodec(const std::string& directory, int level)
+    : directory(directory), level(level) {}
+
+PageCodec::~PageCodec() {
+    if (deflater_ready) deflateEnd(&deflater);
+}
+
+bool PageCodec::methodFromName(const std::string& name, Method& method) {
+    if (name == "none") {
+        method = Method::None;
+    } else if (name == "zlib") {
+        method = Method::Zlib;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string PageCodec::dictionaryPath(const std::string& directory, uint32_t id) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "dict-%08x.zdict", id);
+    return directory + "/" + name;
+}
+
+bool PageCodec::compress(const std::string& data, std::string& out) {
+    if (!deflater_ready) {
+        if (deflateInit(&deflater, level) != Z_OK) return false;
+        deflater_ready = true;
+    } else if (deflateReset(&deflater) != Z_OK) {
+        return false;
+    }
+    if (!dictionary.empty() &&
+        deflateSetDictionary(&deflater, reinterpret_cast<const Bytef*>(dictionary.data()),
+                             static_cast<uInt>(dictionary.size())) != Z_OK) {
+        return false;
+    }
+
+    // The bound does not cover the dictionary id in the stream header
+    out.resize(deflateBound(&deflater, data.size()) + 16);
+    deflater.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    deflater.avail_in = static_cast<uInt>(data.size());
+    deflater.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    deflater.avail_out = static_cast<uInt>(out.size());
+    if (deflate(&deflater, Z_FINISH) != Z_STREAM_END) return false;
+    out.resize(deflater.total_out);
+    return true;
+}
+
+std::shared_ptr<const std::string> PageCodec::loadDictionary(uint32_t id) {
+    std::lock_guard<std::mutex> lock(dictionaries_mutex);
+    auto it = dictionaries.find(id);
+    if (it != dictionaries.end()) return it->second;
+
+    std::string path = dictionaryPath(directory, id);
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Compression dictionary not found: " << path << std::endl;
+        return nullptr;
+    }
+    auto loaded = std::make_shared<std::string>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    uLong checksum = adler32(adler32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(loaded->data()),
+                             static_cast<uInt>(loaded->size()));
+    if (checksum != id) {
+        std::cerr << "Compression dictionary does not match its id: " << path << std::endl;
+        return nullptr;
+    }
+    dictionaries[id] = loaded;
+    return loaded;
+}
+
+bool PageCodec::decompress(const std::string& data, std::string& out) {
+    auto start = Clock::now();
+    z_stream inflater{};
+    if (inflateInit(&inflater) != Z_OK) {
+        decode_failures++;
+        return false;
+    }
+
+    out.resize(std::max<size_t>(data.size() * 4, 4096));
+    inflater.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    inflater.avail_in = static_cast<uInt>(data.size());
+    inflater.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    inflater.avail_out = static_cast<uInt>(out.size());
+
+    int rc = Z_OK;
+    while (true) {
+        rc = inflate(&inflater, Z_NO_FLUSH);
+        if (rc == Z_NEED_DICT) {
+            // The stream names its dictionary by id
+            std::shared_ptr<const std::string> dict = loadDictionary(static_cast<uint32_t>(inflater.adler));
+            if (!dict || inflateSetDictionary(&inflater, reinterpret_cast<const Bytef*>(dict->data()),
+                                              static_cast<uInt>(dict->size())) != Z_OK) {
+                break;
+            }
+            continue;
+        }
+        if (rc == Z_STREAM_END || (rc != Z_OK && rc != Z_BUF_ERROR)) break;
+        if (inflater.avail_out == 0) {
+            size_t used = out.size();
+            out.resize(used * 2);
+            inflater.next_out = reinterpret_cast<Bytef*>(&out[used]);
+            inflater.avail_out = static_cast<uInt>(out.size() - used);
+        } else if (inflater.avail_in == 0) {
+            break;  // Truncated stream
+        }
+    }
+    size_t total = inflater.total_out;
+    inflateEnd(&inflater);
+
+    if (rc != Z_STREAM_END) {
+        decode_failures++;
+        out.clear();
+        return false;
+    }
+    out.resize(total);
+
+    decoded_pages++;
+    encoded_bytes += data.size();
+    decoded_bytes += out.size();
+    decode_us += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    return true;
+}
+
+std::string PageCodec::trainDictionary(const std::vector<std::string>& samples, size_t max_size) {
+    if (samples.empty() || max_size == 0) return "";
+
+    // Number of pages containing each piece
+    std::vector<std::vector<std::string_view>> pages;
+    std::unordered_map<std::string_view, size_t> piece_pages;
+    for (const auto& sample : samples) {
+        pages.push_back(splitPieces(sample));
+        std::unordered_set<std::string_view> seen;
+        for (std::string_view piece : pages.back()) {
+            if (seen.insert(piece).second) piece_pages[piece]++;
+        }
+    }
+    size_t shared = samples.size() == 1 ? 1 : std::max<size_t>(2, (samples.size() + 9) / 10);
+
+    // Consecutive shared pieces form runs, such as a template's header or
+    // footer; matching a whole run beats matching its pieces one by one
+    std::unordered_map<std::string_view, size_t> run_pages;
+    for (const auto& pieces : pages) {
+        std::unordered_set<std::string_view> seen;
+        const char* run_start = nullptr;
+        size_t run_length = 0;
+        auto endRun = [&]() {
+            std::string_view run(run_start, run_length);
+            if (run_length >= kMinRunBytes && seen.insert(run).second) run_pages[run]++;
+            run_start = nullptr;
+            run_length = 0;
+        };
+        for (std::string_view piece : pieces) {
+            if (piece_pages[piece] < shared) {
+                if (run_start) endRun();
+                continue;
+            }
+            if (!run_start) run_start = piece.data();
+            run_length += piece.size();
+        }
+        if (run_start) endRun();
+    }
+
+    // Score by the bytes a candidate would cover across the sample
+    std::vector<std::pair<size_t, std::string_view>> candidates;
+    for (const auto& entry : run_pages) {
+        if (entry.second >= shared) candidates.emplace_back(entry.second * entry.first.size(), entry.first);
+    }
+    for (const auto& entry : piece_pages) {
+        if (entry.second >= shared && entry.first.size() >= kMinRunBytes) {
+            candidates.emplace_back(entry.second * entry.first.size(), entry.first);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    if (candidates.size() > kMaxCandidates) candidates.resize(kMaxCandidates);
+
+    std::vector<std::string_view> chosen;
+    std::string covered;
+    for (const auto& candidate : candidates) {
+        std::string_view text = candidate.second;
+        if (covered.size() + text.size() > max_size) continue;
+        if (covered.find(text) != std::string::npos) continue;
+        chosen.push_back(text);
+        covered.append(text.data(), text.size());
+    }
+
+    // Matches close to the end of the dictionary are the cheapest to encode,
+    // so the most valuable candidates go last
+    std::string dictionary;
+    dictionary.reserve(covered.size());
+    for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+        dictionary.append(it->data(), it->size());
+    }
+    return dictionary;
+}
+
+bool PageCodec::useTrainedDictionary(const std::vector<std::string>& samples) {
+    std::string trained = trainDictionary(samples);
+    if (trained.size() < kMinDictionaryBytes) return false;
+
+    uint32_t id = static_cast<uint32_t>(adler32(adler32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(trained.data()),
+                                                static_cast<uInt>(trained.size())));
+    std::string path = dictionaryPath(directory, id);
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) {
+        // Written under a temporary name so readers never see a partial dictionary
+        std::string temp_path = path + ".tmp";
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out.write(trained.data(), static_cast<std::streamsize>(trained.size()));
+        out.close();
+        if (!out || (std::filesystem::rename(temp_path, path, ec), ec)) {
+            std::cerr << "Failed to save compression dictionary " << path << std::endl;
+            return false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(dictionaries_mutex);
+        dictionaries[id] = std::make_shared<std::string>(trained);
+    }
+    dictionary = std::move(trained);
+    dictionary_id = id;
+    return true;
+}
+
+PageCodec::Stats PageCodec::getStats() const {
+    Stats stats;
+    stats.pages = decoded_pages.load();
+    stats.encoded_bytes = encoded_bytes.load();
+    stats.decoded_bytes = decoded_bytes.load();
+    stats.decode_us = decode_us.load();
+    stats.failures = decode_failures.load();
+    return stats;
+}
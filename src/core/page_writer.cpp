@@ -0,0 +1,385 @@
+#include "page_writer.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace {
+constexpr size_t kMaxBatchPages = 256;
+constexpr size_t kMaxSampleBytes = 128 * 1024;
+
+using Clock = std::chrono::steady_clock;
+
+// Path of a page's file without the .html or .html.z extension
+std::string fileBase(const std::string& directory, const std::string& url) {
+    return directory + "/" + Utils::createSafeFilename(url);
+}
+
+bool syncPath(const std::string& path, bool whole_file_system) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    int rc = whole_file_system ? syncfs(fd) : fsync(fd);
+    ::close(fd);
+    return rc == 0;
+}
+}
+
+PageWriter::PageWriter(const std::string& output_dir, Format format, uint64_t segment_bytes,
+                       size_t max_queue_bytes, FsyncPolicy fsync_policy, std::chrono::milliseconds fsync_interval,
+                       PageCodec::Method compression, size_t dictionary_samples, bool deduplicate)
+    : output_dir(output_dir), dictionary_samples(dictionary_samples), max_queue_bytes(max_queue_bytes),
+      fsync_policy(fsync_policy), fsync_interval(fsync_interval) {
+    if (compression == PageCodec::Method::Zlib) {
+        codec = std::make_unique<PageCodec>(output_dir);
+    }
+    if (format == Format::Segments) {
+        segment_writer = std::make_unique<SegmentWriter>(output_dir, segment_bytes, codec.get());
+    }
+    if (deduplicate) {
+        // Files are rewritten when a page changes; segment records never are
+        content_index = std::make_unique<ContentIndex>(output_dir, format == Format::Files);
+        if (content_index->load()) {
+            std::cout << "Content map: " << content_index->uniqueBodies() << " bodies stored by earlier runs"
+                      << std::endl;
+        }
+    }
+    last_sync = Clock::now();
+    writer_thread = std::thread([this]() { this->writerLoop(); });
+}
+
+PageWriter::~PageWriter() {
+    close();
+}
+
+bool PageWriter::formatFromName(const std::string& name, Format& format) {
+    if (name == "segments") {
+        format = Format::Segments;
+    } else if (name == "files") {
+        format = Format::Files;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool PageWriter::policyFromName(const std::string& name, FsyncPolicy& policy) {
+    if (name == "none") {
+        policy = FsyncPolicy::None;
+    } else if (name == "batch") {
+        policy = FsyncPolicy::Batch;
+    } else if (name == "interval") {
+        policy = FsyncPolicy::Interval;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void PageWriter::submit(PageRecord page) {
+    size_t size = page.url.size() + page.headers.size() + page.body.size();
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (closing) {
+        std::cerr << "Page writer closed, dropping " << page.url << std::endl;
+        stats.failures++;
+        return;
+    }
+
+    // Backpressure: wait for the writer to catch up. A page larger than the
+    // whole queue is still accepted once the queue is empty.
+    if (pending_bytes > 0 && pending_bytes + size > max_queue_bytes) {
+        auto start = Clock::now();
+        space_ready.wait(lock, [&]() {
+            return pending_bytes == 0 || pending_bytes + size <= max_queue_bytes;
+        });
+        stats.stalls++;
+        stats.stall_ms += std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+    }
+
+    pending_bytes += size;
+    queue.push_back(std::move(page));
+    submitted++;
+    lock.unlock();
+    work_ready.notify_one();
+}
+
+void PageWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t target = submitted;
+    space_ready.wait(lock, [&]() { return written >= target; });
+}
+
+void PageWriter::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    work_ready.notify_all();
+    if (!writer_thread.joinable()) return;
+    writer_thread.join();
+
+    bool synced = false;
+    if (segment_writer) {
+        synced = fsync_policy != FsyncPolicy::None ? segment_writer->sync() : segment_writer->flush();
+        segment_writer->close();
+    } else if (fsync_policy != FsyncPolicy::None) {
+        synced = syncPath(output_dir, true);
+    }
+    // The map only ever names pages that are already written
+    if (content_index && !content_index->flush(fsync_policy != FsyncPolicy::None)) synced = false;
+    if (synced && fsync_policy != FsyncPolicy::None) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.fsyncs++;
+    }
+}
+
+bool PageWriter::writeFile(const Page& page, bool sync, uint64_t& raw_bytes, uint64_t& stored_bytes) {
+    std::string path = fileBase(output_dir, page.url) + ".html";
+    std::string compressed;
+    if (codec) {
+        if (!codec->compress(page.body, compressed)) {
+            std::cerr << "Failed to compress " << page.url << std::endl;
+            return false;
+        }
+        path += ".z";
+        raw_bytes += page.body.size();
+        stored_bytes += compressed.size();
+    }
+    const std::string& content = codec ? compressed : page.body;
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (!Utils::writeAll(fd, content)) {
+        std::cerr << "Failed to write " << path << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    bool ok = !sync || fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+// Turns a page whose body is already stored into a revisit of the stored
+// copy. Returns true for such a duplicate.
+bool PageWriter::referToStoredCopy(Page& page) {
+    page.digest = ContentIndex::digest(page.body);
+    const ContentIndex::Original* original = content_index->find(page.digest);
+    if (!original) return false;
+    page.refers_to = original->url;
+    page.refers_to_date = original->fetch_time;
+    return true;
+}
+
+// With one file per URL: returns true if the page's body is already in a
+// file, its own or another URL's, so nothing has to be written
+bool PageWriter::shareFile(const Page& page, const std::string& digest) {
+    std::string previous = content_index->digestOf(page.url);
+    const ContentIndex::Original* original = content_index->find(digest);
+    if (original && original->url == page.url) return true;
+
+    // The file is about to change; another URL with the old body takes it over
+    if (!previous.empty() && previous != digest) {
+        std::string heir = content_index->transfer(page.url, previous);
+        if (!heir.empty()) {
+            std::string from = fileBase(output_dir, page.url), to = fileBase(output_dir, heir);
+            for (const char* extension : {".html", ".html.z"}) {
+                std::rename((from + extension).c_str(), (to + extension).c_str());
+            }
+        }
+    }
+    if (!original) return false;
+
+    // A file left from an earlier body must not outlive it
+    std::string base = fileBase(output_dir, page.url);
+    for (const char* extension : {".html", ".html.z"}) {
+        ::unlink((base + extension).c_str());
+    }
+    return true;
+}
+
+// Makes the batch visible (and durable, depending on the policy). Clears
+// stored if a segment write failed, leaving the map lines held for the
+// caller to drop. Returns the number of fsyncs issued.
+uint64_t PageWriter::finishBatch(bool& stored) {
+    bool interval_due = fsync_policy == FsyncPolicy::Interval && Clock::now() - last_sync >= fsync_interval;
+    if (interval_due) last_sync = Clock::now();
+    bool sync = fsync_policy == FsyncPolicy::Batch || interval_due;
+
+    stored = true;
+    if (segment_writer) {
+        // A failed write cuts the buffered records from the segment
+        if (!segment_writer->flush()) {
+            stored = false;
+            return 0;
+        }
+        // One sync covers the whole batch, however many pages it holds
+        bool synced = !sync || segment_writer->sync();
+        // The content map follows the data it describes
+        if (content_index && !content_index->flush(sync)) synced = false;
+        return sync && synced ? 1 : 0;
+    }
+
+    if (content_index) content_index->flush(sync);
+    // New directory entries must be synced too for the batch to be durable
+    if (fsync_policy == FsyncPolicy::Batch) return syncPath(output_dir, false) ? 1 : 0;
+    if (interval_due) return syncPath(output_dir, true) ? 1 : 0;
+    return 0;
+}
+
+// Keeps the first pages as a dictionary sample and trains once it is complete
+void PageWriter::collectSamples(const std::vector<Page>& batch) {
+    for (const Page& page : batch) {
+        if (samples.size() >= dictionary_samples) break;
+        samples.push_back(page.body.substr(0, kMaxSampleBytes));
+    }
+    if (samples.size() < dictionary_samples) return;
+
+    if (codec->useTrainedDictionary(samples)) {
+        std::cout << "Trained a " << codec->dictionarySize() / 1024 << " KB compression dictionary from "
+                  << samples.size() << " pages" << std::endl;
+    } else {
+        std::cout << "Sample pages share too little markup, compressing without a dictionary" << std::endl;
+    }
+    samples.clear();
+    samples.shrink_to_fit();
+    dictionary_samples = 0;
+}
+
+void PageWriter::writerLoop() {
+    std::vector<Page> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        work_ready.wait(lock, [&]() { return closing || !queue.empty(); });
+        if (queue.empty()) break;   // Closing and fully drained
+
+        batch.clear();
+        while (!queue.empty() && batch.size() < kMaxBatchPages) {
+            batch.push_back(std::move(queue.front()));
+            queue.pop_front();
+        }
+        lock.unlock();
+
+        // Disk I/O runs without the lock so producers can keep queueing
+        if (codec && dictionary_samples > 0) collectSamples(batch);
+        bool sync_each = fsync_policy == FsyncPolicy::Batch && !segment_writer;
+        size_t batch_bytes = 0, body_bytes = 0;
+        uint64_t failures = 0, fsyncs = 0, raw_bytes = 0, stored_bytes = 0, duplicates = 0, duplicate_bytes = 0;
+        // Segment records stay buffered until a write succeeds. Until then
+        // the pages are held: a failed write loses them, and their map lines
+        // must not name records that never reached the disk.
+        uint64_t failed_flushes = segment_writer ? segment_writer->failedFlushes() : 0;
+        uint64_t held = 0, held_duplicates = 0, held_duplicate_bytes = 0;
+        auto dropHeld = [&]() {
+            if (content_index) content_index->discard();
+            failures += held;
+            held = held_duplicates = held_duplicate_bytes = 0;
+            failed_flushes = segment_writer->failedFlushes();
+        };
+        for (Page& page : batch) {
+            batch_bytes += page.url.size() + page.headers.size() + page.body.size();
+            body_bytes += page.body.size();
+            bool duplicate = false, ok;
+            if (segment_writer) {
+                if (content_index) duplicate = referToStoredCopy(page);
+                ok = segment_writer->append(page);
+                // The write that failed took this page too
+                if (segment_writer->failedFlushes() != failed_flushes) dropHeld();
+            } else {
+                if (content_index) {
+                    page.digest = ContentIndex::digest(page.body);
+                    duplicate = shareFile(page, page.digest);
+                }
+                ok = duplicate || writeFile(page, sync_each, raw_bytes, stored_bytes);
+            }
+            if (!ok) {
+                failures++;
+                continue;
+            }
+            if (content_index) content_index->record(page.url, page.fetch_time, page.digest);
+            if (segment_writer) {
+                held++;
+                if (duplicate) {
+                    held_duplicates++;
+                    held_duplicate_bytes += page.body.size();
+                }
+            } else if (duplicate) {
+                duplicates++;
+                duplicate_bytes += page.body.size();
+            } else if (sync_each) {
+                fsyncs++;
+            }
+        }
+        bool stored;
+        fsyncs += finishBatch(stored);
+        if (!stored) {
+            dropHeld();
+        } else {
+            duplicates += held_duplicates;
+            duplicate_bytes += held_duplicate_bytes;
+        }
+        lock.lock();
+        stats.pages += batch.size() - failures;
+        stats.bytes += body_bytes;
+        stats.batches++;
+        stats.fsyncs += fsyncs;
+        stats.failures += failures;
+        stats.duplicates += duplicates;
+        stats.duplicate_bytes += duplicate_bytes;
+        if (segment_writer) {
+            stats.segments = segment_writer->segmentCount();
+            if (codec) {
+                stats.raw_bytes = segment_writer->rawBlockBytes();
+                stats.stored_bytes = segment_writer->storedBlockBytes();
+            }
+        } else {
+            stats.raw_bytes += raw_bytes;
+            stats.stored_bytes += stored_bytes;
+        }
+        if (codec) stats.dictionary_bytes = codec->dictionarySize();
+        pending_bytes -= batch_bytes;
+        written += batch.size();
+        space_ready.notify_all();
+    }
+}
+
+PageWriterStats PageWriter::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void PageWriter::printStats() const {
+    PageWriterStats s = getStats();
+    std::cout << "Storage: " << s.pages << " pages, " << s.bytes / 1024 << " KB in "
+              << s.batches << " batches";
+    if (s.segments > 0) {
+        std::cout << " to " << s.segments << " segments";
+    }
+    std::cout << ", " << s.fsyncs << " fsyncs";
+    if (s.raw_bytes > 0) {
+        std::cout << ", compressed " << s.raw_bytes / 1024 << " KB to " << s.stored_bytes / 1024 << " KB ("
+                  << (s.raw_bytes - std::min(s.raw_bytes, s.stored_bytes)) * 100 / s.raw_bytes << "% saved"
+                  << (s.dictionary_bytes > 0 ? " with a trained dictionary)" : ")");
+    }
+    if (s.duplicates > 0) {
+        std::cout << ", " << s.duplicates << " duplicate bodies (" << s.duplicate_bytes / 1024
+                  << " KB) stored once";
+    }
+    if (s.stalls > 0) {
+        std::cout << ", workers stalled " << s.stalls << " times (" << s.stall_ms << " ms)";
+    }
+    if (s.failures > 0) {
+        std::cout << ", " << s.failures << " failed writes";
+    }
+    std::cout << std::endl;
+}
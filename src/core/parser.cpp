@@ -1,53 +1,271 @@
 #include "parser.h"
 #include "utils.h"
+#include "url_view.h"
+#include "html_scan.h"
 #include <gumbo.h>
-#include <iostream>
+#include <cstring>
+#include <string_view>
+#include <queue>
 
-void LinkParser::extractLinks(const std::string& html, 
-                             const std::string& base_url, 
-                             std::queue<std::string>& url_queue, 
-                             std::unordered_set<std::string>& visited) {
+namespace {
+
+const char* skipPast(const char* p, const char* end, std::string_view terminator) {
+    size_t pos = std::string_view(p, end - p).find(terminator);
+    return pos == std::string_view::npos ? end : p + pos + terminator.size();
+}
+
+void appendUtf8(std::string& out, unsigned long cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Decodes the character references that show up in URLs; others are kept as is
+std::string decodeEntities(std::string_view value) {
+    if (value.find('&') == std::string_view::npos) return std::string(value);
+
+    static const std::pair<std::string_view, char> named[] = {
+        {"amp;", '&'}, {"lt;", '<'}, {"gt;", '>'}, {"quot;", '"'}, {"apos;", '\''}};
+
+    std::string out;
+    out.reserve(value.size());
+    size_t i = 0;
+    while (i < value.size()) {
+        if (value[i] != '&') {
+            out += value[i++];
+            continue;
+        }
+        std::string_view rest = value.substr(i + 1);
+        bool decoded = false;
+        for (const auto& entity : named) {
+            if (rest.substr(0, entity.first.size()) == entity.first) {
+                out += entity.second;
+                i += 1 + entity.first.size();
+                decoded = true;
+                break;
+            }
+        }
+        if (!decoded && !rest.empty() && rest[0] == '#') {
+            bool hex = rest.size() > 1 && (rest[1] == 'x' || rest[1] == 'X');
+            size_t digits = hex ? 2 : 1;
+            size_t semi = rest.find(';');
+            if (semi != std::string_view::npos && semi > digits && semi - digits <= 8) {
+                std::string number(rest.substr(digits, semi - digits));
+                char* parsed_end = nullptr;
+                unsigned long cp = std::strtoul(number.c_str(), &parsed_end, hex ? 16 : 10);
+                if (*parsed_end == '\0' && cp > 0 && cp <= 0x10FFFF) {
+                    appendUtf8(out, cp);
+                    i += 1 + semi + 1;
+                    decoded = true;
+                }
+            }
+        }
+        if (!decoded) out += value[i++];
+    }
+    return out;
+}
+
+std::string trimSpace(const std::string& s) {
+    size_t begin = 0, end = s.size();
+    while (begin < end && HtmlScan::isSpace(s[begin])) ++begin;
+    while (end > begin && HtmlScan::isSpace(s[end - 1])) --end;
+    return s.substr(begin, end - begin);
+}
+
+// Under scope as a path prefix, so http://host does not match http://hostile.com
+bool inScope(const std::string& url, const std::string& scope) {
+    if (url.compare(0, scope.size(), scope) != 0) return false;
+    if (url.size() == scope.size() || scope.empty() || scope.back() == '/') return true;
+    char next = url[scope.size()];
+    return next == '/' || next == '?' || next == '#';
+}
+
+std::vector<std::string> resolveLinks(const std::vector<std::string>& hrefs, const std::string& base_href,
+                                      const std::string& page_url, const std::string& scope,
+                                      LinkParser::LinkFilter* filter) {
+    // <base href> changes what relative links resolve against
+    std::string base = page_url;
+    std::string base_value = trimSpace(base_href);
+    if (!base_value.empty()) {
+        std::string absolute_base = Utils::resolveUrl(page_url, base_value);
+        if (UrlView(absolute_base).isHttp()) base = absolute_base;
+    }
+
+    std::vector<std::string> links;
+    links.reserve(hrefs.size());
+    for (const auto& href : hrefs) {
+        std::string link_url = trimSpace(href);
+
+        // Skip invalid links
+        if (link_url.empty() || link_url[0] == '#') continue;
+
+        // Only follow HTTP/HTTPS links; mailto:, javascript: and the like
+        // carry their own scheme and are never taken for relative paths
+        std::string absolute_url = Utils::resolveUrl(base, link_url);
+        if (!UrlView(absolute_url).isHttp()) continue;
+
+        // Keep links within scope; the caller filters visited ones
+        std::string link = filter && filter->canonicalizer ? filter->canonicalizer->canonicalize(absolute_url)
+                                                           : absolute_url;
+        if (!inScope(link, scope)) continue;
+        if (filter && filter->robots && !filter->robots->allowedUrl(link)) {
+            filter->disallowed++;
+            continue;
+        }
+        if (filter && filter->resolved) filter->resolved->push_back(std::move(absolute_url));
+        links.push_back(std::move(link));
+    }
+    return links;
+}
+
+} // namespace
+
+bool LinkParser::engineFromName(const std::string& name, Engine& engine) {
+    if (name == "tokenizer") {
+        engine = Engine::Tokenizer;
+    } else if (name == "gumbo") {
+        engine = Engine::Gumbo;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::string> LinkParser::extractLinks(const std::string& html,
+                                                 const std::string& page_url,
+                                                 const std::string& scope,
+                                                 Engine engine,
+                                                 LinkFilter* filter) {
+    std::vector<std::string> hrefs;
+    std::string base_href;
+    if (engine == Engine::Gumbo) {
+        extractHrefsGumbo(html, hrefs, base_href);
+    } else {
+        extractHrefsTokenizer(html, hrefs, base_href);
+    }
+    if (filter) filter->disallowed = 0;
+    return resolveLinks(hrefs, base_href, page_url, scope, filter);
+}
+
+void LinkParser::extractHrefsTokenizer(const std::string& html, std::vector<std::string>& hrefs, std::string& base_href) {
+    const char* p = html.data();
+    const char* end = p + html.size();
+    bool have_base = false;
+
+    while ((p = HtmlScan::findTagOpen(p, end)) < end) {
+        ++p;
+        if (p >= end) break;
+
+        // Comments, doctype, processing instructions and end tags carry no links
+        if (*p == '!') {
+            p = (end - p >= 3 && p[1] == '-' && p[2] == '-') ? skipPast(p + 3, end, "-->") : skipPast(p, end, ">");
+            continue;
+        }
+        if (*p == '?' || *p == '/') {
+            p = skipPast(p, end, ">");
+            continue;
+        }
+        if (!HtmlScan::isAlpha(*p)) continue;  // A stray '<' in text
+
+        const char* name = p;
+        p = HtmlScan::tagNameEnd(p, end);
+        size_t name_len = p - name;
+        bool is_anchor = HtmlScan::equalsLower(name, name_len, "a");
+        bool is_base = HtmlScan::equalsLower(name, name_len, "base");
+
+        // Walk the attributes so quoted values containing '>' are skipped correctly
+        std::string_view href;
+        bool has_href = false;
+        while (p < end) {
+            while (p < end && (HtmlScan::isSpace(*p) || *p == '/')) ++p;
+            if (p >= end || *p == '>') break;
+
+            const char* attr = p;
+            while (p < end && !HtmlScan::isSpace(*p) && *p != '=' && *p != '>' && *p != '/') ++p;
+            size_t attr_len = p - attr;
+            while (p < end && HtmlScan::isSpace(*p)) ++p;
+
+            std::string_view value;
+            if (p < end && *p == '=') {
+                ++p;
+                while (p < end && HtmlScan::isSpace(*p)) ++p;
+                if (p < end && (*p == '"' || *p == '\'')) {
+                    char quote = *p++;
+                    const char* close = static_cast<const char*>(std::memchr(p, quote, end - p));
+                    if (!close) close = end;
+                    value = std::string_view(p, close - p);
+                    p = close < end ? close + 1 : end;
+                } else {
+                    const char* start = p;
+                    while (p < end && !HtmlScan::isSpace(*p) && *p != '>') ++p;
+                    value = std::string_view(start, p - start);
+                }
+            }
+
+            if ((is_anchor || is_base) && !has_href && HtmlScan::equalsLower(attr, attr_len, "href")) {
+                href = value;
+                has_href = true;
+            }
+        }
+        if (p < end) ++p;
+
+        if (is_anchor && has_href) {
+            hrefs.push_back(decodeEntities(href));
+        } else if (is_base && has_href && !have_base) {
+            base_href = decodeEntities(href);
+            have_base = true;
+        } else if (HtmlScan::equalsLower(name, name_len, "script")) {
+            p = HtmlScan::skipRawText(p, end, "script");
+        } else if (HtmlScan::equalsLower(name, name_len, "style")) {
+            p = HtmlScan::skipRawText(p, end, "style");
+        }
+    }
+}
+
+void LinkParser::extractHrefsGumbo(const std::string& html, std::vector<std::string>& hrefs, std::string& base_href) {
     GumboOutput* output = gumbo_parse(html.c_str());
     std::queue<GumboNode*> nodes;
     nodes.push(output->root);
-    
+    bool have_base = false;
+
     while (!nodes.empty()) {
         GumboNode* node = nodes.front();
         nodes.pop();
-        
+
         if (node->type != GUMBO_NODE_ELEMENT) continue;
-        
+
+        GumboTag tag = node->v.element.tag;
         GumboAttribute* href = nullptr;
-        if (node->v.element.tag == GUMBO_TAG_A) {
+        if (tag == GUMBO_TAG_A || (tag == GUMBO_TAG_BASE && !have_base)) {
             href = gumbo_get_attribute(&node->v.element.attributes, "href");
         }
-        
+
         // Process child nodes
         GumboVector* children = &node->v.element.children;
         for (unsigned int i = 0; i < children->length; ++i) {
             nodes.push(static_cast<GumboNode*>(children->data[i]));
         }
-        
+
         if (!href) continue;
-        
-        std::string link_url = href->value;
-        
-        // Skip invalid links
-        if (link_url.empty() || link_url[0] == '#') continue;
-        
-        // Resolve relative URLs
-        std::string absolute_url = Utils::resolveUrl(base_url, link_url);
-        
-        // Only follow HTTP/HTTPS links
-        if (absolute_url.find("http://") != 0 && absolute_url.find("https://") != 0) {
-            continue;
-        }
-        
-        // Add new URL to queue if not visited and within domain
-        if (absolute_url.find(base_url) == 0 && visited.find(absolute_url) == visited.end()) {
-            visited.insert(absolute_url);
-            url_queue.push(absolute_url);
+
+        if (tag == GUMBO_TAG_BASE) {
+            base_href = href->value;
+            have_base = true;
+        } else {
+            hrefs.push_back(href->value);
         }
     }
     gumbo_destroy_output(&kGumboDefaultOptions, output);
-}
\ No newline at end of file
+}
@@ -0,0 +1,156 @@
+#include "recrawl_cache.h"
+#include "utils.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+std::string validatorsPath(const std::string& directory) {
+    return directory + "/.validators";
+}
+
+// Tabs and line breaks would break the one-entry-per-line file format
+std::string sanitize(std::string value) {
+    std::replace_if(value.begin(), value.end(), [](char c) { return c == '\t' || c == '\r' || c == '\n'; }, ' ');
+    return value;
+}
+
+} // namespace
+
+RecrawlCache::RecrawlCache(const std::string& directory) : directory(directory) {}
+
+std::string RecrawlCache::changedListPath(const std::string& directory) {
+    return directory + "/changed.txt";
+}
+
+Validators RecrawlCache::parseValidators(const std::string& headers) {
+    Validators validators;
+    std::istringstream in(headers);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+
+        size_t start = line.find_first_not_of(" \t", colon + 1);
+        std::string value = start == std::string::npos ? "" : line.substr(start);
+        if (Utils::headerNameIs(line, colon, "etag")) {
+            validators.etag = sanitize(value);
+        } else if (Utils::headerNameIs(line, colon, "last-modified")) {
+            validators.last_modified = sanitize(value);
+        }
+    }
+    return validators;
+}
+
+bool RecrawlCache::load() {
+    std::ifstream in(validatorsPath(directory));
+    if (!in.is_open()) return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t first = line.find('\t');
+        size_t second = first == std::string::npos ? std::string::npos : line.find('\t', first + 1);
+        if (second == std::string::npos) continue;
+
+        Validators& validators = entries[line.substr(0, first)];
+        validators.etag = line.substr(first + 1, second - first - 1);
+        validators.last_modified = line.substr(second + 1);
+    }
+    return true;
+}
+
+bool RecrawlCache::save() const {
+    std::string path = validatorsPath(directory);
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::trunc);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : entries) {
+            out << entry.first << '\t' << entry.second.etag << '\t' << entry.second.last_modified << '\n';
+        }
+        if (!out) {
+            std::cerr << "Failed to write " << temp_path << std::endl;
+            return false;
+        }
+    }
+
+    // Replace the old cache in one step so a crash never leaves half of it
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::cerr << "Failed to replace " << path << ": " << ec.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool RecrawlCache::lookup(const std::string& url, Validators& validators) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(url);
+    if (it == entries.end()) return false;
+    validators = it->second;
+    return true;
+}
+
+void RecrawlCache::recordChanged(const std::string& url, const std::string& headers) {
+    Validators validators = parseValidators(headers);
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[url] = std::move(validators);
+    changed_count++;
+    if (changed_list.is_open()) changed_list << url << '\n';
+}
+
+void RecrawlCache::forget(const std::string& url) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.erase(url);
+}
+
+std::vector<std::string> RecrawlCache::urls() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> result;
+    result.reserve(entries.size());
+    for (const auto& entry : entries) {
+        result.push_back(entry.first);
+    }
+    return result;
+}
+
+size_t RecrawlCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+uint64_t RecrawlCache::changedCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return changed_count;
+}
+
+bool RecrawlCache::openChangedList(bool append) {
+    std::lock_guard<std::mutex> lock(mutex);
+    changed_list.open(changedListPath(directory), append ? std::ios::app : std::ios::trunc);
+    if (!changed_list.is_open()) {
+        std::cerr << "Failed to open " << changedListPath(directory) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void RecrawlCache::flushChangedList() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (changed_list.is_open()) changed_list.flush();
+}
+
+bool RecrawlCache::readChangedList(const std::string& path, std::unordered_set<std::string>& urls) {
+    std::ifstream in(path);
+    if (!in.is_open()) return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty()) urls.insert(line);
+    }
+    return true;
+}
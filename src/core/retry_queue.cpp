@@ -0,0 +1,178 @@
+#include "retry_queue.h"
+#include "utils.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+std::string failureText(const DownloadResult& result) {
+    // A refusal aborted by our own limits is reported by its status
+    if (result.error == CURLE_OK || result.status_code >= 400) return "HTTP " + std::to_string(result.status_code);
+    return curl_easy_strerror(result.error);
+}
+
+} // namespace
+
+RetryQueue::RetryQueue(int max_retries, std::chrono::milliseconds base_delay, std::chrono::milliseconds max_delay,
+                       Requeue requeue)
+    : max_retries(max_retries), base_delay(std::max(std::chrono::milliseconds(1), base_delay)),
+      max_delay(std::max(this->base_delay, max_delay)), requeue(std::move(requeue)),
+      random(std::random_device{}()) {
+    timer_thread = std::thread([this]() { this->timerLoop(); });
+}
+
+RetryQueue::~RetryQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    timer_thread.join();
+}
+
+bool RetryQueue::retryable(const DownloadResult& result) {
+    // Checked first: a refusal aborted by our own type or size limits is
+    // still a refusal, and its Retry-After still counts
+    switch (result.status_code) {
+        case 408: case 425: case 429: case 500: case 502: case 503: case 504:
+            return true;
+        default:
+            break;
+    }
+    switch (result.error) {
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+            return true;
+        default:
+            // Our own aborts and local errors would fail the same way again
+            return false;
+    }
+}
+
+long RetryQueue::retryAfter(const std::string& headers) {
+    std::istringstream in(headers);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t colon = line.find(':');
+        if (colon == std::string::npos || !Utils::headerNameIs(line, colon, "retry-after")) continue;
+
+        size_t start = line.find_first_not_of(" \t", colon + 1);
+        if (start == std::string::npos) return -1;
+        std::string value = line.substr(start);
+        if (std::all_of(value.begin(), value.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+            return std::atol(value.c_str());
+        }
+        time_t at = curl_getdate(value.c_str(), nullptr);
+        if (at < 0) return -1;
+        return std::max<long>(0, static_cast<long>(at - std::time(nullptr)));
+    }
+    return -1;
+}
+
+std::chrono::milliseconds RetryQueue::backoff(int retry) {
+    double full = std::min<double>(max_delay.count(), base_delay.count() * std::ldexp(1.0, retry - 1));
+    auto half = static_cast<long long>(full / 2);
+    return std::chrono::milliseconds(half + std::uniform_int_distribution<long long>(0, half)(random));
+}
+
+bool RetryQueue::retry(const DownloadResult& result) {
+    bool failed = retryable(result);
+    bool scheduled = false;
+    std::ostringstream message;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = attempts.find(result.url);
+        if (!failed) {
+            if (it != attempts.end()) {
+                if (result.error == CURLE_OK && result.status_code < 400) stats.recovered++;
+                attempts.erase(it);
+            }
+            return false;
+        }
+
+        int retries = it == attempts.end() ? 0 : it->second;
+        std::chrono::milliseconds delay = backoff(retries + 1);
+        long after = retryAfter(result.headers);
+        bool give_up = retries >= max_retries ||
+                       (after >= 0 && std::chrono::seconds(after) > max_delay);
+        if (give_up) {
+            if (it != attempts.end()) attempts.erase(it);
+            stats.exhausted++;
+            message << "Giving up on " << result.url << " (" << failureText(result) << ") ";
+            if (retries >= max_retries) {
+                message << "after " << retries << " retries";
+            } else {
+                message << "that asks to wait " << after << " s";
+            }
+        } else {
+            if (after >= 0) {
+                delay = std::max<std::chrono::milliseconds>(delay, std::chrono::seconds(after));
+                stats.retry_after++;
+            }
+            attempts[result.url] = retries + 1;
+            wheel.schedule(result.url, Clock::now() + delay);
+            stats.scheduled++;
+            scheduled = true;
+            wake.notify_one();
+            message << "Retrying in " << delay.count() / 1000.0 << " s: " << result.url << " ("
+                    << failureText(result) << ", retry " << retries + 1 << " of " << max_retries << ")";
+        }
+    }
+    std::cout << message.str() << std::endl;
+    return scheduled;
+}
+
+void RetryQueue::timerLoop() {
+    std::vector<std::string> due;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        if (wheel.empty()) {
+            wake.wait(lock, [&]() { return stopping || !wheel.empty(); });
+            continue;
+        }
+        wake.wait_for(lock, wheel.tick());
+        due.clear();
+        wheel.advance(Clock::now(), due);
+        if (due.empty()) continue;
+        stats.requeued += due.size();
+
+        // The callback takes frontier locks; workers may be waiting for this one
+        lock.unlock();
+        for (const auto& url : due) {
+            requeue(url);
+        }
+        lock.lock();
+    }
+}
+
+size_t RetryQueue::waiting() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return wheel.size();
+}
+
+RetryQueue::Stats RetryQueue::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void RetryQueue::printStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << "Retries: " << stats.scheduled << " scheduled (" << stats.retry_after << " after Retry-After), "
+              << stats.requeued << " fetched again, " << stats.recovered << " URLs recovered, " << stats.exhausted
+              << " given up";
+    if (!wheel.empty()) std::cout << ", " << wheel.size() << " still waiting when the crawl stopped";
+    std::cout << std::endl;
+}
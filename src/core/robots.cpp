@@ -0,0 +1,228 @@
+#include "robots.h"
+#include "url_view.h"
+#include "utils.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+// RFC 9309 asks crawlers to parse at least 500 KiB
+constexpr size_t kMaxRobotsBytes = 512 * 1024;
+// A host whose robots.txt could not be fetched is retried this soon
+constexpr std::chrono::seconds kUnreachableRetry{600};
+
+std::string toLower(std::string s) {
+    for (char& c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return s;
+}
+
+std::string trim(const std::string& s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+} // namespace
+
+void RobotsRules::addRule(std::string pattern, bool allow) {
+    rule_count++;
+    // A trailing '*' adds nothing to a prefix match
+    while (!pattern.empty() && pattern.back() == '*') pattern.pop_back();
+    bool anchored = !pattern.empty() && pattern.back() == '$';
+    if (anchored) pattern.pop_back();
+
+    if (anchored || pattern.find('*') != std::string::npos) {
+        wildcards.push_back(Pattern{std::move(pattern), anchored, allow});
+        return;
+    }
+
+    uint32_t node = 0;
+    for (char c : pattern) {
+        auto& children = trie[node].children;
+        auto it = std::find_if(children.begin(), children.end(), [c](const auto& child) { return child.first == c; });
+        if (it != children.end()) {
+            node = it->second;
+            continue;
+        }
+        uint32_t child = static_cast<uint32_t>(trie.size());
+        children.emplace_back(c, child);
+        trie.emplace_back();
+        node = child;
+    }
+    // Allow wins when the same pattern is both allowed and disallowed
+    if (trie[node].verdict != kAllow) trie[node].verdict = allow ? kAllow : kDisallow;
+}
+
+RobotsRules RobotsRules::parse(const std::string& body, const std::string& agent) {
+    struct Rule {
+        bool allow;
+        std::string pattern;
+    };
+    std::vector<Rule> own_rules, any_rules;
+    double own_delay = -1, any_delay = -1;
+    bool found_own = false;
+
+    // A group is a run of user-agent lines followed by the rules for them
+    bool in_agents = false, for_own = false, for_any = false;
+    std::string wanted = toLower(agent);
+
+    RobotsRules rules;
+    std::istringstream in(body.size() > kMaxRobotsBytes ? body.substr(0, kMaxRobotsBytes) : body);
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string key = toLower(trim(line.substr(0, colon)));
+        std::string value = trim(line.substr(colon + 1));
+        // A byte order mark may precede the first key
+        if (key.compare(0, 3, "\xef\xbb\xbf") == 0) key.erase(0, 3);
+
+        if (key == "user-agent") {
+            if (!in_agents) for_own = for_any = false;
+            in_agents = true;
+            // Only the product token counts, e.g. "WebCrawler" of "WebCrawler/1.0"
+            std::string token = toLower(value.substr(0, value.find_first_of("/ \t")));
+            if (token == "*") {
+                for_any = true;
+            } else if (token == wanted) {
+                for_own = true;
+                found_own = true;
+            }
+            continue;
+        }
+        if (key == "sitemap") {
+            if (!value.empty()) rules.sitemap_urls.push_back(value);
+            continue;
+        }
+        in_agents = false;
+
+        if (key == "allow" || key == "disallow") {
+            // An empty Disallow allows everything, which is the default anyway
+            if (value.empty()) continue;
+            Rule rule{key == "allow", value};
+            if (for_own) own_rules.push_back(rule);
+            if (for_any) any_rules.push_back(rule);
+        } else if (key == "crawl-delay") {
+            char* end = nullptr;
+            double seconds = std::strtod(value.c_str(), &end);
+            if (end == value.c_str() || seconds < 0) continue;
+            if (for_own) own_delay = seconds;
+            if (for_any) any_delay = seconds;
+        }
+    }
+
+    for (auto& rule : found_own ? own_rules : any_rules) {
+        rules.addRule(std::move(rule.pattern), rule.allow);
+    }
+    double delay = found_own ? own_delay : any_delay;
+    if (delay > 0) rules.crawl_delay = std::chrono::milliseconds(static_cast<long long>(delay * 1000));
+    return rules;
+}
+
+RobotsRules RobotsRules::disallowAll() {
+    RobotsRules rules;
+    rules.addRule("/", false);
+    return rules;
+}
+
+bool RobotsRules::allowed(std::string_view path) const {
+    int best = -1;
+    bool allow = true;
+    auto consider = [&](int length, bool is_allow) {
+        if (length > best || (length == best && is_allow)) {
+            best = length;
+            allow = is_allow;
+        }
+    };
+
+    // Every node passed on the walk is a prefix of path; deeper is longer
+    uint32_t node = 0;
+    if (trie[0].verdict != kNone) consider(0, trie[0].verdict == kAllow);
+    for (size_t i = 0; i < path.size(); ++i) {
+        const auto& children = trie[node].children;
+        auto it = std::find_if(children.begin(), children.end(),
+                               [c = path[i]](const auto& child) { return child.first == c; });
+        if (it == children.end()) break;
+        node = it->second;
+        if (trie[node].verdict != kNone) consider(static_cast<int>(i + 1), trie[node].verdict == kAllow);
+    }
+
+    for (const auto& wildcard : wildcards) {
+        int length = static_cast<int>(wildcard.pattern.size());
+        if (length < best) continue;
+        if (Utils::globMatch(wildcard.pattern, path, wildcard.anchored)) consider(length, wildcard.allow);
+    }
+    return allow;
+}
+
+bool RobotsRules::allowedUrl(const std::string& url) const {
+    std::string_view path = UrlView(url).pathAndQuery();
+    return allowed(path.empty() ? std::string_view("/") : path);
+}
+
+RobotsCache::RobotsCache(const std::string& agent, std::chrono::seconds ttl, Fetcher fetcher,
+                         FetchListener listener)
+    : agent(agent), ttl(ttl), fetcher(std::move(fetcher)), listener(std::move(listener)) {}
+
+std::shared_ptr<const RobotsRules> RobotsCache::fetchRules(const std::string& origin, bool& unreachable) {
+    DownloadResult result = fetcher(origin + "/robots.txt");
+    unreachable = false;
+    if (result.error == CURLE_OK && result.status_code >= 200 && result.status_code < 300) {
+        return std::make_shared<RobotsRules>(RobotsRules::parse(result.body, agent));
+    }
+    if (result.error == CURLE_OK && result.status_code >= 400 && result.status_code < 500) {
+        return std::make_shared<RobotsRules>();  // No robots.txt: nothing is disallowed
+    }
+
+    unreachable = true;
+    std::cerr << "robots.txt of " << origin << " could not be fetched (";
+    if (result.error != CURLE_OK) {
+        std::cerr << curl_easy_strerror(result.error);
+    } else {
+        std::cerr << "status " << result.status_code;
+    }
+    std::cerr << "), treating the host as disallowed" << std::endl;
+    return std::make_shared<RobotsRules>(RobotsRules::disallowAll());
+}
+
+std::shared_ptr<const RobotsRules> RobotsCache::rulesFor(const std::string& origin) {
+    std::unique_lock<std::mutex> lock(mutex);
+    Entry& entry = entries[origin];
+    while (true) {
+        // Fresh rules, or stale ones while another thread refetches them
+        if (entry.rules && (entry.fetching || std::chrono::steady_clock::now() < entry.expires)) return entry.rules;
+        if (!entry.fetching) break;
+        fetched.wait(lock);     // The first fetch for this host is under way
+    }
+    entry.fetching = true;
+    lock.unlock();
+
+    bool unreachable = false;
+    std::shared_ptr<const RobotsRules> rules = fetchRules(origin, unreachable);
+
+    lock.lock();
+    entry.rules = rules;
+    entry.expires = std::chrono::steady_clock::now() + (unreachable ? std::min(ttl, kUnreachableRetry) : ttl);
+    entry.fetching = false;
+    fetch_count++;
+    if (unreachable) unreachable_count++;
+    lock.unlock();
+    fetched.notify_all();
+
+    if (listener) listener(origin, *rules);
+    return rules;
+}
+
+RobotsCache::Stats RobotsCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats;
+    stats.hosts = entries.size();
+    stats.fetches = fetch_count;
+    stats.unreachable = unreachable_count;
+    return stats;
+}
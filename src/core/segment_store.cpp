@@ -0,0 +1,414 @@
+#include "segment_store.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+namespace {
+
+constexpr size_t kFlushBytes = 4 * 1024 * 1024;
+const std::string kSegmentPrefix = "pages-";
+const std::string kSegmentExtension = ".warc";
+const std::string kIndexExtension = ".idx";
+
+// curl hands over the decoded, de-chunked body, so the stored headers must
+// not describe the wire: Content-Encoding, Transfer-Encoding and a
+// Content-Length that does not match are kept as X-Crawler-Original-*, and
+// the block states the stored body's length
+std::string storedHeaders(const std::string& headers, size_t body_length) {
+    std::string out;
+    out.reserve(headers.size() + 64);
+    std::string length = std::to_string(body_length);
+    bool has_length = false;
+    size_t start = 0;
+    while (start < headers.size()) {
+        size_t end = headers.find('\n', start);
+        end = end == std::string::npos ? headers.size() : end + 1;
+        std::string line = headers.substr(start, end - start);
+        start = end;
+        if (line.back() != '\n') line += "\r\n";
+        size_t text_end = line.find_last_not_of("\r\n");
+        if (text_end == std::string::npos) break;  // The empty line ending the block
+
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            bool is_length = Utils::headerNameIs(line, colon, "content-length");
+            if (is_length) {
+                size_t value = line.find_first_not_of(" \t", colon + 1);
+                if (value != std::string::npos && line.compare(value, text_end + 1 - value, length) == 0) {
+                    has_length = true;
+                    out += line;
+                    continue;
+                }
+            }
+            if (is_length || Utils::headerNameIs(line, colon, "content-encoding") ||
+                Utils::headerNameIs(line, colon, "transfer-encoding")) {
+                out += "X-Crawler-Original-" + line;
+                continue;
+            }
+        }
+        out += line;
+    }
+    if (!has_length) out += "Content-Length: " + length + "\r\n";
+    out += "\r\n";
+    return out;
+}
+
+std::string newRecordId() {
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    uint64_t hi = rng(), lo = rng();
+    hi = (hi & ~0xF000ULL) | 0x4000ULL;                             // Version 4
+    lo = (lo & ~(3ULL << 62)) | (2ULL << 62);                       // RFC 4122 variant
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "<urn:uuid:%08llx-%04llx-%04llx-%04llx-%012llx>",
+                  static_cast<unsigned long long>(hi >> 32), static_cast<unsigned long long>((hi >> 16) & 0xFFFF),
+                  static_cast<unsigned long long>(hi & 0xFFFF), static_cast<unsigned long long>(lo >> 48),
+                  static_cast<unsigned long long>(lo & 0xFFFFFFFFFFFFULL));
+    return buffer;
+}
+
+// Segment number of a pages-NNNNN.warc file name, or -1
+long long segmentId(const std::filesystem::path& path) {
+    std::string name = path.filename().string();
+    if (name.size() <= kSegmentPrefix.size() + kSegmentExtension.size() ||
+        name.compare(0, kSegmentPrefix.size(), kSegmentPrefix) != 0 ||
+        path.extension() != kSegmentExtension) {
+        return -1;
+    }
+    std::string digits = name.substr(kSegmentPrefix.size(), name.size() - kSegmentPrefix.size() - kSegmentExtension.size());
+    if (digits.empty() || !std::all_of(digits.begin(), digits.end(), ::isdigit)) return -1;
+    return std::stoll(digits);
+}
+
+std::string indexPath(const std::string& segment_path) {
+    return std::filesystem::path(segment_path).replace_extension(kIndexExtension).string();
+}
+
+bool equalsIgnoreCase(const std::string& a, const char* b) {
+    size_t len = std::strlen(b);
+    if (a.size() != len) return false;
+    for (size_t i = 0; i < len; ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != b[i]) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// --- SegmentWriter ---
+
+SegmentWriter::SegmentWriter(const std::string& directory, uint64_t segment_bytes, PageCodec* codec)
+    : directory(directory), segment_bytes(segment_bytes), codec(codec) {
+    std::vector<std::string> existing = SegmentReader::listSegments(directory);
+    if (!existing.empty()) {
+        next_segment_id = static_cast<uint64_t>(segmentId(existing.back())) + 1;
+    }
+}
+
+SegmentWriter::~SegmentWriter() {
+    close();
+}
+
+std::string SegmentWriter::formatDate(std::chrono::system_clock::time_point time) {
+    std::time_t tt = std::chrono::system_clock::to_time_t(time);
+    std::tm tm{};
+    gmtime_r(&tt, &tm);
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    return buffer;
+}
+
+bool SegmentWriter::openSegment() {
+    if (!Utils::createOutputDirectory(directory)) return false;
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%05llu", static_cast<unsigned long long>(next_segment_id++));
+    std::string path = directory + "/" + kSegmentPrefix + name + kSegmentExtension;
+
+    data_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    index_fd = ::open(indexPath(path).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (data_fd < 0 || index_fd < 0) {
+        std::cerr << "Failed to open segment " << path << ": " << std::strerror(errno) << std::endl;
+        closeSegment();
+        return false;
+    }
+    offset = 0;
+    flushed_data = 0;
+    flushed_index = 0;
+    segments_written++;
+    return true;
+}
+
+bool SegmentWriter::closeSegment() {
+    // A sealed segment is never written again, so make it durable once
+    bool ok = flush();
+    if (ok && data_fd >= 0) {
+        fsync(data_fd);
+        fsync(index_fd);
+    }
+    if (data_fd >= 0) ::close(data_fd);
+    if (index_fd >= 0) ::close(index_fd);
+    data_fd = -1;
+    index_fd = -1;
+    return ok;
+}
+
+bool SegmentWriter::append(const PageRecord& record) {
+    if (data_fd < 0 && !openSegment()) return false;
+
+    // With headers the block is the full HTTP response, as in WARC response records
+    bool is_response = !record.headers.empty();
+    bool is_revisit = !record.refers_to.empty();
+    // Ends with the empty line closing the header block
+    std::string headers = is_response ? storedHeaders(record.headers, record.body.size()) : std::string();
+    // A revisit repeats only the headers
+    static const std::string no_body;
+    const std::string& body = is_revisit ? no_body : record.body;
+    uint64_t block_length = headers.size() + body.size();
+    raw_block_bytes += block_length;
+
+    std::string compressed;
+    bool is_compressed = false;
+    if (codec && block_length > 0) {
+        is_compressed = codec->compress(headers + body, compressed);
+        if (is_compressed) {
+            block_length = compressed.size();
+        } else {
+            std::cerr << "Failed to compress " << record.url << ", storing it uncompressed" << std::endl;
+        }
+    }
+    stored_block_bytes += block_length;
+
+    std::string header = "WARC/1.0\r\n";
+    if (is_revisit) {
+        header += "WARC-Type: revisit\r\n";
+    } else {
+        header += is_response ? "WARC-Type: response\r\n" : "WARC-Type: resource\r\n";
+    }
+    header += "WARC-Record-ID: " + newRecordId() + "\r\n";
+    header += "WARC-Date: " + record.fetch_time + "\r\n";
+    header += "WARC-Target-URI: " + record.url + "\r\n";
+    if (is_revisit) {
+        header += "WARC-Profile: http://netpreserve.org/warc/1.0/revisit/identical-payload-digest\r\n";
+        header += "WARC-Refers-To-Target-URI: " + record.refers_to + "\r\n";
+        if (!record.refers_to_date.empty()) header += "WARC-Refers-To-Date: " + record.refers_to_date + "\r\n";
+    }
+    if (!record.digest.empty()) header += "WARC-Payload-Digest: " + record.digest + "\r\n";
+    if (is_response) {
+        header += "Content-Type: application/http; msgtype=response\r\n";
+    } else if (!is_revisit) {
+        header += "Content-Type: text/html\r\n";
+    }
+    if (is_compressed) header += "WARC-Block-Encoding: deflate\r\n";
+    header += "Content-Length: " + std::to_string(block_length) + "\r\n\r\n";
+
+    uint64_t record_length = header.size() + block_length + 4;
+    index_buffer += std::to_string(offset) + " " + std::to_string(record_length) + " " + record.url + "\n";
+    data_buffer += header;
+    if (is_compressed) {
+        data_buffer += compressed;
+    } else {
+        data_buffer += headers;
+        data_buffer += body;
+    }
+    data_buffer += "\r\n\r\n";
+    offset += record_length;
+
+    // A full segment is sealed after the record that filled it, so a write
+    // failing here always takes this record with the earlier buffered ones
+    if (offset >= segment_bytes) {
+        return closeSegment();
+    }
+    if (data_buffer.size() >= kFlushBytes) {
+        return flush();
+    }
+    return true;
+}
+
+bool SegmentWriter::flush() {
+    if (data_fd < 0) return data_buffer.empty();
+
+    // Data first, so the index never points past what is on disk
+    bool ok = Utils::writeAll(data_fd, data_buffer) && Utils::writeAll(index_fd, index_buffer);
+    if (ok) {
+        flushed_data += data_buffer.size();
+        flushed_index += index_buffer.size();
+    } else {
+        std::cerr << "Failed to write segment data: " << std::strerror(errno) << std::endl;
+        failed_flushes++;
+        // Cut both files back to the last complete flush and seal the segment,
+        // so no index entry points at a partial or shifted record; the next
+        // append starts a new segment
+        if (ftruncate(data_fd, static_cast<off_t>(flushed_data)) != 0 ||
+            ftruncate(index_fd, static_cast<off_t>(flushed_index)) != 0) {
+            std::cerr << "Failed to truncate the segment after a failed write: " << std::strerror(errno) << std::endl;
+        }
+        ::close(data_fd);
+        ::close(index_fd);
+        data_fd = -1;
+        index_fd = -1;
+        offset = flushed_data;
+    }
+    data_buffer.clear();
+    index_buffer.clear();
+    return ok;
+}
+
+bool SegmentWriter::sync() {
+    if (!flush()) return false;
+    if (data_fd < 0) return true;
+    return fsync(data_fd) == 0 && fsync(index_fd) == 0;
+}
+
+void SegmentWriter::close() {
+    closeSegment();
+}
+
+// --- SegmentReader ---
+
+SegmentReader::SegmentReader(const std::string& path, PageCodec* codec)
+    : in(path, std::ios::binary), path(path), codec(codec) {}
+
+bool SegmentReader::readRecord(PageRecord& record, bool& decoded) {
+    decoded = true;
+    std::string line;
+    auto getLine = [&]() {
+        if (!std::getline(in, line)) return false;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        return true;
+    };
+
+    // Records are separated by blank lines
+    do {
+        if (!getLine()) return false;
+    } while (line.empty());
+    if (line.compare(0, 5, "WARC/") != 0) return false;
+
+    record = PageRecord();
+    std::string type;
+    std::string encoding;
+    uint64_t length = 0;
+    bool have_length = false;
+    while (getLine() && !line.empty()) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = line.substr(0, colon);
+        size_t value_start = line.find_first_not_of(' ', colon + 1);
+        std::string value = value_start == std::string::npos ? "" : line.substr(value_start);
+
+        if (equalsIgnoreCase(name, "content-length")) {
+            length = std::strtoull(value.c_str(), nullptr, 10);
+            have_length = true;
+        } else if (equalsIgnoreCase(name, "warc-type")) {
+            type = value;
+        } else if (equalsIgnoreCase(name, "warc-target-uri")) {
+            record.url = value;
+        } else if (equalsIgnoreCase(name, "warc-date")) {
+            record.fetch_time = value;
+        } else if (equalsIgnoreCase(name, "warc-block-encoding")) {
+            encoding = value;
+        } else if (equalsIgnoreCase(name, "warc-payload-digest")) {
+            record.digest = value;
+        } else if (equalsIgnoreCase(name, "warc-refers-to-target-uri")) {
+            record.refers_to = value;
+        } else if (equalsIgnoreCase(name, "warc-refers-to-date")) {
+            record.refers_to_date = value;
+        }
+    }
+    if (!have_length) return false;
+
+    std::string block(length, '\0');
+    if (length > 0 && !in.read(&block[0], static_cast<std::streamsize>(length))) return false;
+
+    if (!encoding.empty()) {
+        if (!codec) {
+            // Dictionaries are stored next to the segments
+            std::string directory = std::filesystem::path(path).parent_path().string();
+            own_codec = std::make_unique<PageCodec>(directory.empty() ? "." : directory);
+            codec = own_codec.get();
+        }
+        std::string compressed = std::move(block);
+        if (encoding != "deflate" || !codec->decompress(compressed, block)) {
+            std::cerr << "Failed to decode record " << record.url << " in " << path << std::endl;
+            decoded = false;
+            return true;
+        }
+    }
+
+    // Refers-To fields only mean something on revisit records
+    if (type != "revisit") {
+        record.refers_to.clear();
+        record.refers_to_date.clear();
+    }
+    size_t split = type == "response" || type == "revisit" ? block.find("\r\n\r\n") : std::string::npos;
+    if (split != std::string::npos) {
+        record.headers = block.substr(0, split + 4);
+        record.body = block.substr(split + 4);
+    } else {
+        record.body = std::move(block);
+    }
+    return true;
+}
+
+bool SegmentReader::next(PageRecord& record) {
+    if (!in.is_open()) return false;
+    bool decoded = false;
+    while (readRecord(record, decoded)) {
+        if (decoded) return true;
+    }
+    return false;
+}
+
+bool SegmentReader::readAt(uint64_t offset, PageRecord& record) {
+    if (!in.is_open()) return false;
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(offset));
+    bool decoded = false;
+    return readRecord(record, decoded) && decoded;
+}
+
+bool SegmentReader::isSegmentFile(const std::string& path) {
+    return segmentId(path) >= 0;
+}
+
+std::vector<std::string> SegmentReader::listSegments(const std::string& directory) {
+    std::vector<std::pair<long long, std::string>> found;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        long long id = segmentId(entry.path());
+        if (id >= 0 && entry.is_regular_file()) {
+            found.emplace_back(id, entry.path().string());
+        }
+    }
+    std::sort(found.begin(), found.end());
+
+    std::vector<std::string> segments;
+    for (auto& segment : found) {
+        segments.push_back(std::move(segment.second));
+    }
+    return segments;
+}
+
+bool SegmentReader::readIndex(const std::string& segment_path, std::vector<IndexEntry>& entries) {
+    std::ifstream index(indexPath(segment_path));
+    if (!index.is_open()) return false;
+
+    std::string line;
+    while (std::getline(index, line)) {
+        std::istringstream fields(line);
+        IndexEntry entry;
+        if (!(fields >> entry.offset >> entry.length)) continue;
+        std::getline(fields >> std::ws, entry.url);
+        entries.push_back(std::move(entry));
+    }
+    return true;
+}
@@ -0,0 +1,149 @@
+#include "simhash.h"
+#include "html_scan.h"
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+
+namespace {
+
+// Letters, digits and every byte of a multi-byte UTF-8 sequence
+inline bool isWordByte(char c) {
+    unsigned char u = static_cast<unsigned char>(c);
+    return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') || u >= 0x80;
+}
+
+inline uint64_t mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+inline uint64_t rotl(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+} // namespace
+
+uint64_t SimHash::fromHtml(const std::string& html, size_t* features) {
+    int32_t votes[64] = {};
+    uint64_t previous[2] = {0, 0};  // Hashes of the two words before the current one
+    size_t words = 0, count = 0;
+
+    const char* p = html.data();
+    const char* end = p + html.size();
+    while (p < end) {
+        if (*p == '<') {
+            const char* tag = p + 1;
+            if (end - tag >= 3 && std::memcmp(tag, "!--", 3) == 0) {
+                const char* close = std::search(tag + 3, end, "-->", "-->" + 3);
+                p = close < end ? close + 3 : end;
+                continue;
+            }
+            const char* close = static_cast<const char*>(std::memchr(p, '>', end - p));
+            if (!close) break;
+            p = close + 1;
+            // Text inside scripts and styles is not content; the closing tag
+            // is then read as any other
+            size_t name_len = HtmlScan::tagNameEnd(tag, close) - tag;
+            if (HtmlScan::equalsLower(tag, name_len, "script")) {
+                p = HtmlScan::skipRawText(p, end, "script");
+            } else if (HtmlScan::equalsLower(tag, name_len, "style")) {
+                p = HtmlScan::skipRawText(p, end, "style");
+            }
+            continue;
+        }
+        if (!isWordByte(*p)) {
+            ++p;
+            continue;
+        }
+
+        // FNV-1a of the lowercased word
+        uint64_t word = 0xcbf29ce484222325ull;
+        while (p < end && isWordByte(*p)) {
+            word = (word ^ static_cast<unsigned char>(HtmlScan::toLower(*p++))) * 0x100000001b3ull;
+        }
+        if (++words >= 3) {
+            uint64_t feature = mix(word ^ rotl(previous[1], 21) ^ rotl(previous[0], 42));
+            for (int bit = 0; bit < 64; ++bit) {
+                votes[bit] += ((feature >> bit) & 1) ? 1 : -1;
+            }
+            count++;
+        }
+        previous[0] = previous[1];
+        previous[1] = word;
+    }
+
+    uint64_t fingerprint = 0;
+    for (int bit = 0; bit < 64; ++bit) {
+        if (votes[bit] > 0) fingerprint |= uint64_t(1) << bit;
+    }
+    if (features) *features = count;
+    return fingerprint;
+}
+
+int SimHash::distance(uint64_t a, uint64_t b) {
+    return static_cast<int>(std::bitset<64>(a ^ b).count());
+}
+
+NearDuplicateIndex::NearDuplicateIndex(int threshold, size_t window)
+    : threshold(std::max(0, std::min(16, threshold))), window(std::max<size_t>(1, window)) {
+    // threshold + 1 bands as even as 64 bits allow
+    int band_count = this->threshold + 1;
+    int shift = 0;
+    for (int i = 0; i < band_count; ++i) {
+        int width = 64 / band_count + (i < 64 % band_count ? 1 : 0);
+        Band band;
+        band.shift = shift;
+        band.mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+        bands.push_back(std::move(band));
+        shift += width;
+    }
+}
+
+bool NearDuplicateIndex::findOrInsert(uint64_t fingerprint, const std::string& url, Match& match) {
+    std::lock_guard<std::mutex> lock(mutex);
+    int best = threshold + 1;
+    const Slot* nearest = nullptr;
+    for (const Band& band : bands) {
+        auto it = band.slots.find(bandValue(band, fingerprint));
+        if (it == band.slots.end()) continue;
+        for (uint32_t index : it->second) {
+            int distance = SimHash::distance(fingerprint, ring[index].fingerprint);
+            if (distance < best) {
+                best = distance;
+                nearest = &ring[index];
+            }
+        }
+    }
+    if (nearest) {
+        match.url = nearest->url;
+        match.distance = best;
+        return true;
+    }
+
+    // Take the next slot, dropping its oldest fingerprint from every band
+    uint32_t index = static_cast<uint32_t>(next_slot);
+    next_slot = (next_slot + 1) % window;
+    if (index < ring.size()) {
+        for (Band& band : bands) {
+            auto it = band.slots.find(bandValue(band, ring[index].fingerprint));
+            if (it == band.slots.end()) continue;
+            auto& slots = it->second;
+            slots.erase(std::remove(slots.begin(), slots.end(), index), slots.end());
+            if (slots.empty()) band.slots.erase(it);
+        }
+    } else {
+        ring.emplace_back();
+    }
+    ring[index].fingerprint = fingerprint;
+    ring[index].url = url;
+    for (Band& band : bands) {
+        band.slots[bandValue(band, fingerprint)].push_back(index);
+    }
+    return false;
+}
+
+size_t NearDuplicateIndex::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return ring.size();
+}
@@ -0,0 +1,292 @@
+#include "sitemap.h"
+#include "downloader.h"
+#include <deque>
+#include <iostream>
+#include <unordered_set>
+
+namespace {
+
+// Sitemap URLs must be shorter than 2048 characters; longer ones are skipped
+constexpr size_t kMaxUrlBytes = 8192;
+constexpr size_t kMaxTagBytes = 64;
+constexpr size_t kInflateChunk = 16 * 1024;
+constexpr size_t kBatchSize = 1024;
+// The protocol caps a sitemap at 50 MB uncompressed
+constexpr uint64_t kMaxSitemapBytes = 64ull * 1024 * 1024;
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+std::string trim(const std::string& s) {
+    size_t begin = 0, end = s.size();
+    while (begin < end && isSpace(s[begin])) ++begin;
+    while (end > begin && isSpace(s[end - 1])) --end;
+    return s.substr(begin, end - begin);
+}
+
+// Sitemaps must escape '&', '<', '>', '"' and '\'' as entities
+std::string decodeEntities(const std::string& s) {
+    static const std::pair<const char*, char> kEntities[] = {
+        {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''},
+    };
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size();) {
+        bool decoded = false;
+        if (s[i] == '&') {
+            for (const auto& entity : kEntities) {
+                size_t length = std::char_traits<char>::length(entity.first);
+                if (s.compare(i, length, entity.first) == 0) {
+                    out += entity.second;
+                    i += length;
+                    decoded = true;
+                    break;
+                }
+            }
+        }
+        if (!decoded) out += s[i++];
+    }
+    return out;
+}
+
+} // namespace
+
+SitemapParser::SitemapParser(UrlCallback callback) : callback(std::move(callback)) {}
+
+SitemapParser::~SitemapParser() {
+    if (inflater_ready) inflateEnd(&inflater);
+}
+
+bool SitemapParser::feed(const char* data, size_t size) {
+    if (corrupt) return false;
+
+    // gzip is recognized by its two magic bytes, whatever the response headers say
+    if (!gzip_checked) {
+        size_t take = std::min(size, 2 - gzip_magic.size());
+        gzip_magic.append(data, take);
+        data += take;
+        size -= take;
+        if (gzip_magic.size() < 2) return true;
+
+        gzip_checked = true;
+        gzipped = gzip_magic == "\x1f\x8b";
+        if (gzipped) {
+            if (inflateInit2(&inflater, 16 + MAX_WBITS) != Z_OK) {
+                corrupt = true;
+                return false;
+            }
+            inflater_ready = true;
+        }
+        if (!consume(gzip_magic.data(), gzip_magic.size())) return false;
+    }
+    return consume(data, size);
+}
+
+bool SitemapParser::consume(const char* data, size_t size) {
+    if (!gzipped) {
+        scan(data, size);
+        return true;
+    }
+
+    char out[kInflateChunk];
+    inflater.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    inflater.avail_in = static_cast<uInt>(size);
+    while (inflater.avail_in > 0) {
+        inflater.next_out = reinterpret_cast<Bytef*>(out);
+        inflater.avail_out = sizeof(out);
+        int rc = inflate(&inflater, Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+            corrupt = true;
+            return false;
+        }
+        scan(out, sizeof(out) - inflater.avail_out);
+        // A gzip file may hold several members back to back
+        if (rc == Z_STREAM_END) {
+            inflateReset(&inflater);
+        } else if (rc == Z_BUF_ERROR) {
+            break;
+        }
+    }
+    return true;
+}
+
+void SitemapParser::finish() {
+    if (!gzip_checked && !gzip_magic.empty()) {
+        gzip_checked = true;
+        scan(gzip_magic.data(), gzip_magic.size());
+    }
+    if (state == State::PlainText) emitLoc(false);
+}
+
+void SitemapParser::appendLoc(char c) {
+    if (loc.size() >= kMaxUrlBytes) {
+        loc_overflow = true;
+    } else {
+        loc += c;
+    }
+}
+
+void SitemapParser::emitLoc(bool xml) {
+    std::string url = trim(loc);
+    bool overflow = loc_overflow;
+    loc.clear();
+    loc_overflow = false;
+    if (url.empty() || overflow) return;
+    // A <loc> counts only inside <url> or <sitemap>
+    if (xml && !in_url && !in_sitemap) return;
+
+    url_count++;
+    callback(xml ? decodeEntities(url) : url, xml && in_sitemap);
+}
+
+void SitemapParser::endTagName(char next) {
+    std::string name = tag;
+    bool closing = !name.empty() && name[0] == '/';
+    if (closing) name.erase(0, 1);
+    size_t colon = name.find(':');    // Namespace prefix
+    if (colon != std::string::npos) name.erase(0, colon + 1);
+
+    if (name == "loc") {
+        if (closing && in_loc) emitLoc(true);
+        in_loc = !closing;
+        if (in_loc) {
+            loc.clear();
+            loc_overflow = false;
+        }
+    } else if (name == "url") {
+        in_url = !closing;
+    } else if (name == "sitemap") {
+        in_sitemap = !closing;
+    }
+    state = next == '>' ? State::Text : State::TagRest;
+}
+
+void SitemapParser::scan(const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        char c = data[i];
+        switch (state) {
+        case State::Sniff:
+            // Skip leading space and a byte order mark; XML starts with '<'
+            if (isSpace(c) || static_cast<unsigned char>(c) >= 0x80) break;
+            if (c == '<') {
+                state = State::Tag;
+                tag.clear();
+            } else {
+                state = State::PlainText;
+                appendLoc(c);
+            }
+            break;
+
+        case State::PlainText:
+            if (c == '\n') {
+                emitLoc(false);
+            } else {
+                appendLoc(c);
+            }
+            break;
+
+        case State::Text:
+            if (c == '<') {
+                state = State::Tag;
+                tag.clear();
+            } else if (in_loc) {
+                appendLoc(c);
+            }
+            break;
+
+        case State::Tag:
+            if (isSpace(c) || c == '>' || (c == '/' && !tag.empty())) {
+                endTagName(c);
+                break;
+            }
+            if (tag.size() < kMaxTagBytes) tag += c;
+            if (tag == "!--") {
+                state = State::Comment;
+                marker_run = 0;
+            } else if (tag == "![CDATA[") {
+                state = State::CData;
+                marker_run = 0;
+            }
+            break;
+
+        case State::TagRest:
+            if (c == '>') state = State::Text;
+            break;
+
+        case State::Comment:
+            if (c == '>' && marker_run >= 2) {
+                state = State::Text;
+            }
+            marker_run = c == '-' ? marker_run + 1 : 0;
+            break;
+
+        case State::CData:
+            if (c == '>' && marker_run >= 2) {
+                // Take back the "]]" that closed the section
+                if (in_loc && !loc_overflow && loc.size() >= 2) loc.resize(loc.size() - 2);
+                state = State::Text;
+                break;
+            }
+            marker_run = c == ']' ? marker_run + 1 : 0;
+            if (in_loc) appendLoc(c);
+            break;
+        }
+    }
+}
+
+SitemapLoader::SitemapLoader(BatchCallback on_batch, size_t max_sitemaps)
+    : on_batch(std::move(on_batch)), max_sitemaps(max_sitemaps) {}
+
+void SitemapLoader::load(const std::vector<std::string>& roots) {
+    std::deque<std::string> queue(roots.begin(), roots.end());
+    std::unordered_set<std::string> seen;
+    DownloadLimits limits;
+    limits.max_body_bytes = kMaxSitemapBytes;
+
+    while (!queue.empty() && seen.size() < max_sitemaps) {
+        std::string sitemap_url = std::move(queue.front());
+        queue.pop_front();
+        if (!seen.insert(sitemap_url).second) continue;
+
+        std::vector<std::string> batch;
+        uint64_t pages = 0, children = 0;
+        SitemapParser parser([&](std::string url, bool is_sitemap) {
+            if (is_sitemap) {
+                // Only as many children are kept as may still be read
+                if (seen.size() + queue.size() < max_sitemaps) queue.push_back(std::move(url));
+                children++;
+                return;
+            }
+            pages++;
+            batch.push_back(std::move(url));
+            if (batch.size() >= kBatchSize) {
+                on_batch(batch);
+                batch.clear();
+            }
+        });
+
+        BodySink sink = [&parser](const char* data, size_t size) { return parser.feed(data, size); };
+        DownloadResult result = Downloader::stream(sitemap_url, sink, limits);
+        parser.finish();
+        if (!batch.empty()) on_batch(batch);
+
+        stats.bytes += result.body_bytes;
+        stats.urls += pages;
+        if (result.error != CURLE_OK || result.status_code < 200 || result.status_code >= 300) {
+            stats.failed++;
+            std::cerr << "Could not read sitemap " << sitemap_url;
+            if (result.abort_reason != AbortReason::None) {
+                std::cerr << " (" << Downloader::abortReasonName(result.abort_reason) << ")";
+            } else if (result.error == CURLE_OK) {
+                std::cerr << " (status " << result.status_code << ")";
+            }
+            std::cerr << std::endl;
+            continue;
+        }
+        stats.sitemaps++;
+        std::cout << "Sitemap " << sitemap_url << ": " << pages << " URLs";
+        if (children > 0) std::cout << ", " << children << " sitemaps";
+        std::cout << std::endl;
+    }
+}
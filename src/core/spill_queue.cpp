@@ -0,0 +1,170 @@
+#include "spill_queue.h"
+#include "utils.h"
+#include <filesystem>
+#include <iostream>
+
+namespace {
+constexpr size_t kWriteBufferBytes = 1024 * 1024;
+}
+
+SpillQueue::SpillQueue(const std::string& directory, size_t segment_bytes)
+    : directory(directory), segment_bytes(segment_bytes) {}
+
+SpillQueue::~SpillQueue() {
+    writer.close();
+    reader.close();
+    if (retain_segments) return; // Still referenced by the last checkpoint
+    for (const auto& segment : segments) {
+        std::error_code ec;
+        std::filesystem::remove(segment.path, ec);
+    }
+}
+
+bool SpillQueue::openWriteSegment() {
+    if (segments.empty() && !Utils::createOutputDirectory(directory)) {
+        return false;
+    }
+
+    Segment segment;
+    segment.path = directory + "/frontier-" + std::to_string(next_segment_id++) + ".seg";
+    writer.close();
+    writer.open(segment.path, std::ios::binary | std::ios::trunc);
+    if (!writer.is_open()) {
+        std::cerr << "Failed to open frontier segment: " << segment.path << std::endl;
+        return false;
+    }
+    segments.push_back(segment);
+    return true;
+}
+
+void SpillQueue::flushWriteBuffer() {
+    if (write_buffer.empty()) return;
+
+    if ((segments.empty() || segments.back().bytes >= segment_bytes) && !openWriteSegment()) {
+        return;
+    }
+    writer.write(write_buffer.data(), write_buffer.size());
+    writer.flush();
+    segments.back().bytes += write_buffer.size();
+    write_buffer.clear();
+}
+
+void SpillQueue::push(const std::string& url) {
+    write_buffer.append(url);
+    write_buffer.push_back('\n');
+    count++;
+    total_spilled++;
+
+    if (write_buffer.size() >= kWriteBufferBytes) {
+        flushWriteBuffer();
+    }
+}
+
+size_t SpillQueue::popBatch(std::vector<std::string>& out, size_t max_items) {
+    size_t read = 0;
+
+    while (read < max_items && count > 0) {
+        // The oldest entries may still be sitting in the write buffer
+        if (segments.empty() || (segments.size() == 1 && read_offset >= segments.front().bytes)) {
+            flushWriteBuffer();
+            if (segments.empty() || !write_buffer.empty()) break; // Segment could not be written
+        }
+
+        Segment& front = segments.front();
+        if (!reader.is_open()) {
+            reader.open(front.path, std::ios::binary);
+            reader.seekg(static_cast<std::streamoff>(read_offset));
+        }
+
+        std::string line;
+        while (read < max_items && read_offset < front.bytes && std::getline(reader, line)) {
+            read_offset += line.size() + 1;
+            out.push_back(std::move(line));
+            read++;
+            count--;
+        }
+
+        if (read_offset >= front.bytes) {
+            reader.close();
+            if (segments.size() > 1) {
+                // Fully consumed and no longer written to
+                retireSegment(front.path);
+                segments.pop_front();
+                read_offset = 0;
+            } else if (write_buffer.empty()) {
+                break;
+            }
+        } else if (!reader) {
+            std::cerr << "Failed to read frontier segment: " << front.path << std::endl;
+            reader.close();
+            break;
+        }
+    }
+
+    return read;
+}
+
+void SpillQueue::retireSegment(const std::string& path) {
+    if (retain_segments) {
+        retired.push_back(path);
+        return;
+    }
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+}
+
+void SpillQueue::releaseRetired(size_t n) {
+    while (n-- > 0 && !retired.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(retired.front(), ec);
+        retired.pop_front();
+    }
+}
+
+SpillQueue::State SpillQueue::snapshot(size_t& retired_before) {
+    flushWriteBuffer();
+    retired_before = retired.size();
+
+    State state;
+    for (const auto& segment : segments) {
+        state.segments.emplace_back(std::filesystem::path(segment.path).filename().string(), segment.bytes);
+    }
+    state.read_offset = read_offset;
+    state.count = count;
+    state.next_segment_id = next_segment_id;
+    return state;
+}
+
+bool SpillQueue::restore(const State& state) {
+    writer.close();
+    reader.close();
+    segments.clear();
+    write_buffer.clear();
+
+    for (const auto& entry : state.segments) {
+        Segment segment;
+        segment.path = directory + "/" + entry.first;
+        segment.bytes = entry.second;
+
+        std::error_code ec;
+        if (!std::filesystem::exists(segment.path, ec)) {
+            std::cerr << "Missing frontier segment: " << segment.path << std::endl;
+            return false;
+        }
+        std::filesystem::resize_file(segment.path, segment.bytes, ec);
+        if (ec) {
+            std::cerr << "Could not truncate frontier segment " << segment.path << ": " << ec.message() << std::endl;
+            return false;
+        }
+        segments.push_back(segment);
+    }
+
+    read_offset = state.read_offset;
+    count = state.count;
+    next_segment_id = state.next_segment_id;
+
+    if (!segments.empty()) {
+        writer.open(segments.back().path, std::ios::binary | std::ios::app);
+    }
+    return true;
+}
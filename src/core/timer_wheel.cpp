@@ -0,0 +1,62 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick)
+    : tick_length(std::max(std::chrono::milliseconds(1), tick)), origin(Clock::now()) {}
+
+void TimerWheel::schedule(std::string item, Clock::time_point due) {
+    // Rounded up, so an item never expires before its time
+    uint64_t tick = 0;
+    if (due > origin) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(due - origin + tick_length -
+                                                                        std::chrono::milliseconds(1));
+        tick = static_cast<uint64_t>(ms / tick_length);
+    }
+    // The current tick's slot has been emptied already
+    place(Timer{std::max(tick, current + 1), std::move(item)});
+    count++;
+}
+
+void TimerWheel::place(Timer timer) {
+    uint64_t delta = timer.due - current;
+    int level = 0;
+    while (level < kLevels - 1 && delta >= uint64_t(1) << (kSlotBits * (level + 1))) {
+        level++;
+    }
+    // Beyond the top level's span: wait in its farthest slot
+    uint64_t span = uint64_t(1) << (kSlotBits * kLevels);
+    uint64_t at = delta < span ? timer.due : current + span - 1;
+    slots[level][(at >> (kSlotBits * level)) & (kSlots - 1)].push_back(std::move(timer));
+}
+
+void TimerWheel::cascade(int level) {
+    std::vector<Timer> timers;
+    timers.swap(slots[level][(current >> (kSlotBits * level)) & (kSlots - 1)]);
+    for (auto& timer : timers) {
+        place(std::move(timer));
+    }
+}
+
+void TimerWheel::advance(Clock::time_point now, std::vector<std::string>& expired) {
+    if (now < origin) return;
+    uint64_t target = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now - origin) /
+                                            tick_length);
+    while (current < target) {
+        if (count == 0) {
+            current = target;
+            break;
+        }
+        current++;
+        // Each level's slot comes round when the levels below wrap
+        for (int level = 1; level < kLevels; ++level) {
+            if (current & ((uint64_t(1) << (kSlotBits * level)) - 1)) break;
+            cascade(level);
+        }
+        std::vector<Timer>& slot = slots[0][current & (kSlots - 1)];
+        for (auto& timer : slot) {
+            expired.push_back(std::move(timer.item));
+        }
+        count -= slot.size();
+        slot.clear();
+    }
+}
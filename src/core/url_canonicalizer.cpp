@@ -0,0 +1,291 @@
+#include "url_canonicalizer.h"
+#include "url_view.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+// Query parameters that only identify the visit, not the resource
+const char* const kTrackingParams[] = {
+    "utm_*", "gclid", "dclid", "gbraid", "wbraid", "fbclid", "msclkid", "yclid",
+    "mc_cid", "mc_eid", "_ga", "_gl", "igshid", "phpsessid", "jsessionid", "sessionid",
+};
+
+const char kHex[] = "0123456789ABCDEF";
+
+// Directory part of the base path with the reference appended (section 5.2.3)
+std::string mergePaths(const UrlView& base, std::string_view path) {
+    std::string merged;
+    if (base.hasAuthority() && base.path().empty()) {
+        merged = "/";
+    } else {
+        size_t slash = base.path().rfind('/');
+        if (slash != std::string_view::npos) merged = base.path().substr(0, slash + 1);
+    }
+    merged += path;
+    return merged;
+}
+
+void appendTail(std::string& out, std::string_view path, bool has_query, std::string_view query,
+                bool has_fragment, std::string_view fragment) {
+    out += path;
+    if (has_query) {
+        out += '?';
+        out += query;
+    }
+    if (has_fragment) {
+        out += '#';
+        out += fragment;
+    }
+}
+
+void appendLower(std::string& out, std::string_view s) {
+    for (char c : s) out += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+std::string toLower(std::string_view s) {
+    std::string lower;
+    lower.reserve(s.size());
+    appendLower(lower, s);
+    return lower;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool isUnreserved(unsigned char c) {
+    return std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+// Uppercases escapes, decodes escaped unreserved characters and escapes
+// bytes that may not appear in a URL at all (spaces, non-ASCII, ...)
+std::string normalizeEscapes(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c == '%') {
+            int high = i + 2 < s.size() ? hexValue(s[i + 1]) : -1;
+            int low = high >= 0 ? hexValue(s[i + 2]) : -1;
+            if (low < 0) {
+                out += "%25";  // A lone '%' stands for itself
+                continue;
+            }
+            unsigned char decoded = static_cast<unsigned char>(high * 16 + low);
+            if (isUnreserved(decoded)) {
+                out += static_cast<char>(decoded);
+            } else {
+                out += '%';
+                out += kHex[high];
+                out += kHex[low];
+            }
+            i += 2;
+        } else if (c <= 0x20 || c >= 0x7f || std::strchr("\"<>\\^`{|}", c)) {
+            out += '%';
+            out += kHex[c >> 4];
+            out += kHex[c & 0xf];
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    return out;
+}
+
+bool startsWith(std::string_view s, size_t pos, std::string_view prefix) {
+    return s.substr(pos, prefix.size()) == prefix;
+}
+
+bool restEquals(std::string_view s, size_t pos, std::string_view rest) {
+    return s.substr(pos) == rest;
+}
+
+void popSegment(std::string& output) {
+    size_t slash = output.rfind('/');
+    output.erase(slash == std::string::npos ? 0 : slash);
+}
+
+} // namespace
+
+UrlCanonicalizer::UrlCanonicalizer(const Rules& rules) : rules(rules) {}
+
+bool UrlCanonicalizer::rulesFromNames(const std::string& names, Rules& rules) {
+    Rules parsed;
+    parsed.drop_tracking = false;
+    parsed.sort_query = false;
+    parsed.drop_params = rules.drop_params;
+
+    std::stringstream list(names);
+    std::string name;
+    bool any = false;
+    while (std::getline(list, name, ',')) {
+        if (name == "drop-tracking") {
+            parsed.drop_tracking = true;
+        } else if (name == "sort-query") {
+            parsed.sort_query = true;
+        } else if (name != "none") {
+            return false;
+        }
+        any = true;
+    }
+    if (!any) return false;
+    rules = parsed;
+    return true;
+}
+
+std::string UrlCanonicalizer::removeDotSegments(std::string_view path) {
+    // Section 5.2.4, walking the input buffer instead of copying it
+    std::string output;
+    output.reserve(path.size());
+    size_t i = 0;
+    while (i < path.size()) {
+        if (startsWith(path, i, "../")) {
+            i += 3;
+        } else if (startsWith(path, i, "./")) {
+            i += 2;
+        } else if (startsWith(path, i, "/./")) {
+            i += 2;
+        } else if (restEquals(path, i, "/.")) {
+            output += '/';
+            break;
+        } else if (startsWith(path, i, "/../")) {
+            i += 3;
+            popSegment(output);
+        } else if (restEquals(path, i, "/..")) {
+            popSegment(output);
+            output += '/';
+            break;
+        } else if (restEquals(path, i, ".") || restEquals(path, i, "..")) {
+            break;
+        } else {
+            size_t end = std::min(path.find('/', i + 1), path.size());
+            output += path.substr(i, end - i);
+            i = end;
+        }
+    }
+    return output;
+}
+
+std::string UrlCanonicalizer::resolve(const std::string& base, const std::string& ref) {
+    // Section 5.2.2
+    UrlView r(ref);
+    std::string target;
+    if (r.hasScheme()) {
+        target.reserve(ref.size());
+        target += r.scheme();
+        target += ':';
+        if (r.hasAuthority()) {
+            target += "//";
+            target += r.authority();
+        }
+        appendTail(target, removeDotSegments(r.path()), r.hasQuery(), r.query(), r.hasFragment(), r.fragment());
+        return target;
+    }
+
+    UrlView b(base);
+    if (!b.hasScheme()) return "";
+
+    target.reserve(base.size() + ref.size());
+    target += b.scheme();
+    target += ':';
+    const UrlView& origin = r.hasAuthority() ? r : b;
+    if (origin.hasAuthority()) {
+        target += "//";
+        target += origin.authority();
+    }
+    if (r.hasAuthority()) {
+        appendTail(target, removeDotSegments(r.path()), r.hasQuery(), r.query(), r.hasFragment(), r.fragment());
+    } else if (r.path().empty()) {
+        appendTail(target, b.path(), r.hasQuery() || b.hasQuery(), r.hasQuery() ? r.query() : b.query(),
+                   r.hasFragment(), r.fragment());
+    } else {
+        std::string path = r.path()[0] == '/' ? removeDotSegments(r.path()) : removeDotSegments(mergePaths(b, r.path()));
+        appendTail(target, path, r.hasQuery(), r.query(), r.hasFragment(), r.fragment());
+    }
+    return target;
+}
+
+bool UrlCanonicalizer::dropParam(std::string_view name) const {
+    std::string lower = toLower(name);
+    auto matches = [&lower](const std::string& pattern) {
+        if (!pattern.empty() && pattern.back() == '*') {
+            return lower.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0;
+        }
+        return lower == pattern;
+    };
+    if (rules.drop_tracking) {
+        for (const char* pattern : kTrackingParams) {
+            if (matches(pattern)) return true;
+        }
+    }
+    for (const auto& pattern : rules.drop_params) {
+        if (matches(toLower(pattern))) return true;
+    }
+    return false;
+}
+
+std::string UrlCanonicalizer::normalizeQuery(const std::string& query) const {
+    if (!rules.drop_tracking && !rules.sort_query && rules.drop_params.empty()) return query;
+
+    std::string_view rest = query;
+    std::vector<std::string_view> params;
+    while (true) {
+        size_t end = std::min(rest.find('&'), rest.size());
+        std::string_view param = rest.substr(0, end);
+        if (!param.empty() && !dropParam(param.substr(0, param.find('=')))) params.push_back(param);
+        if (end == rest.size()) break;
+        rest.remove_prefix(end + 1);
+    }
+
+    // Stable, so repeated names keep their order, which may be significant
+    if (rules.sort_query) {
+        std::stable_sort(params.begin(), params.end(), [](std::string_view a, std::string_view b) {
+            return a.substr(0, a.find('=')) < b.substr(0, b.find('='));
+        });
+    }
+
+    std::string out;
+    for (const auto& param : params) {
+        if (!out.empty()) out += '&';
+        out += param;
+    }
+    return out;
+}
+
+std::string UrlCanonicalizer::canonicalize(const std::string& url) const {
+    UrlView view(url);
+    if (!view.isHttp()) return url;
+    bool https = view.schemeIs("https");
+
+    std::string canonical;
+    canonical.reserve(url.size());
+    canonical += https ? "https://" : "http://";
+    if (view.authority().find('@') != std::string_view::npos) {
+        canonical += view.userinfo();
+        canonical += '@';
+    }
+    appendLower(canonical, view.host());
+    std::string_view port = view.port();
+    while (port.size() > 1 && port[0] == '0') port.remove_prefix(1);
+    if (!port.empty() && port != (https ? "443" : "80")) {
+        canonical += ':';
+        canonical += port;
+    }
+
+    std::string path = removeDotSegments(normalizeEscapes(view.path()));
+    canonical += path.empty() ? "/" : path;
+    if (view.hasQuery()) {
+        std::string query = normalizeQuery(normalizeEscapes(view.query()));
+        if (!query.empty()) {
+            canonical += '?';
+            canonical += query;
+        }
+    }
+    // The fragment is dropped: it never reaches the server
+    return canonical;
+}
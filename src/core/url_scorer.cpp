@@ -0,0 +1,109 @@
+#include "url_scorer.h"
+#include "url_view.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+
+namespace {
+
+// 4 rows of 2^18 counters: 4 MB whatever the size of the crawl
+constexpr int kSketchRows = 4;
+constexpr int kSketchWidthBits = 18;
+constexpr size_t kSketchWidth = size_t(1) << kSketchWidthBits;
+// Odd multipliers that give each row its own hash
+constexpr uint64_t kRowSeeds[kSketchRows] = {
+    0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull, 0xd6e8feb86659fd93ull,
+};
+
+} // namespace
+
+bool UrlScorer::policyFromName(const std::string& name, Policy& policy) {
+    if (name == "bfs") {
+        policy = Policy::Bfs;
+    } else if (name == "best-first") {
+        policy = Policy::BestFirst;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* UrlScorer::policyName(Policy policy) {
+    return policy == Policy::BestFirst ? "best-first" : "bfs";
+}
+
+bool UrlScorer::weightsFromSpec(const std::string& spec, Weights& weights) {
+    std::stringstream items(spec);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        if (item.empty()) continue;
+        size_t equals = item.rfind('=');
+        if (equals == std::string::npos || equals == 0) return false;
+        std::string value = item.substr(equals + 1);
+        char* end = nullptr;
+        double weight = std::strtod(value.c_str(), &end);
+        if (value.empty() || *end != '\0') return false;
+        weights.patterns.emplace_back(item.substr(0, equals), weight);
+    }
+    return true;
+}
+
+UrlScorer::UrlScorer(Policy policy, const Weights& weights, PluginFunction plugin)
+    : policy(policy), depth_weight(weights.depth), inlink_weight(weights.inlinks), plugin(plugin) {
+    for (const auto& entry : weights.patterns) {
+        std::string pattern = entry.first;
+        bool anchored = !pattern.empty() && pattern.back() == '$';
+        if (anchored) pattern.pop_back();
+        patterns.push_back(Pattern{std::move(pattern), anchored, entry.second});
+    }
+    // Inlinks are only counted when something reads them
+    if (policy == Policy::BestFirst && (inlink_weight != 0 || plugin)) {
+        inlink_counts = std::make_unique<std::atomic<uint32_t>[]>(kSketchRows * kSketchWidth);
+        for (size_t i = 0; i < kSketchRows * kSketchWidth; ++i) inlink_counts[i] = 0;
+    }
+}
+
+size_t UrlScorer::slot(size_t hash, int row) const {
+    uint64_t mixed = (static_cast<uint64_t>(hash) ^ (static_cast<uint64_t>(hash) >> 31)) * kRowSeeds[row];
+    return row * kSketchWidth + static_cast<size_t>(mixed >> (64 - kSketchWidthBits));
+}
+
+double UrlScorer::score(const std::string& url, int depth) const {
+    if (policy == Policy::Bfs) return 0;
+
+    double total = -depth_weight * depth;
+    if (!patterns.empty()) {
+        std::string_view path = UrlView(url).pathAndQuery();
+        if (path.empty()) path = "/";
+        for (const auto& pattern : patterns) {
+            if (Utils::globMatch(pattern.pattern, path, pattern.anchored)) total += pattern.weight;
+        }
+    }
+    unsigned int links = inlink_counts ? inlinks(url) : 0;
+    if (inlink_weight != 0 && links > 0) total += inlink_weight * std::log2(1.0 + links);
+    if (plugin) total += plugin(url.c_str(), depth, links);
+    return total;
+}
+
+void UrlScorer::countInlinks(const std::vector<std::string>& urls) {
+    if (!inlink_counts) return;
+    for (const auto& url : urls) {
+        size_t hash = std::hash<std::string>{}(url);
+        for (int row = 0; row < kSketchRows; ++row) {
+            inlink_counts[slot(hash, row)].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+unsigned int UrlScorer::inlinks(const std::string& url) const {
+    if (!inlink_counts) return 0;
+    size_t hash = std::hash<std::string>{}(url);
+    uint32_t count = UINT32_MAX;
+    for (int row = 0; row < kSketchRows; ++row) {
+        count = std::min(count, inlink_counts[slot(hash, row)].load(std::memory_order_relaxed));
+    }
+    return count;
+}
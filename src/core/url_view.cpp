@@ -0,0 +1,99 @@
+#include "url_view.h"
+
+namespace {
+
+inline bool isAlpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+inline bool isSchemeChar(char c) {
+    return isAlpha(c) || (c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.';
+}
+
+} // namespace
+
+UrlView::UrlView(std::string_view url) : url(url) {
+    const size_t n = url.size();
+    size_t pos = 0;
+
+    // Scheme characters never include ':', '/', '?' or '#', so the scheme is
+    // whatever run of them is ended by a ':'
+    size_t i = 0;
+    while (i < n && isSchemeChar(url[i])) ++i;
+    if (i > 0 && i < n && url[i] == ':' && isAlpha(url[0])) {
+        has_scheme = true;
+        scheme_ = url.substr(0, i);
+        pos = i + 1;
+    }
+
+    if (n - pos >= 2 && url[pos] == '/' && url[pos + 1] == '/') {
+        size_t start = pos + 2;
+        size_t at = std::string_view::npos;
+        size_t colon = std::string_view::npos;
+        bool in_brackets = false;     // IPv6 literals contain colons of their own
+        for (i = start; i < n; ++i) {
+            char c = url[i];
+            if (c == '/' || c == '?' || c == '#') break;
+            if (c == '@') {
+                at = i;
+                colon = std::string_view::npos;
+            } else if (c == '[') {
+                in_brackets = true;
+            } else if (c == ']') {
+                in_brackets = false;
+            } else if (c == ':' && !in_brackets) {
+                colon = i;
+            }
+        }
+        has_authority = true;
+        authority_ = url.substr(start, i - start);
+        size_t host_start = start;
+        if (at != std::string_view::npos) {
+            userinfo_ = url.substr(start, at - start);
+            host_start = at + 1;
+        }
+        if (colon != std::string_view::npos) {
+            host_ = url.substr(host_start, colon - host_start);
+            port_ = url.substr(colon + 1, i - colon - 1);
+        } else {
+            host_ = url.substr(host_start, i - host_start);
+        }
+        pos = i;
+    }
+
+    for (i = pos; i < n && url[i] != '?' && url[i] != '#'; ++i) {}
+    path_ = url.substr(pos, i - pos);
+    pos = i;
+    if (pos < n && url[pos] == '?') {
+        for (i = pos + 1; i < n && url[i] != '#'; ++i) {}
+        has_query = true;
+        query_ = url.substr(pos + 1, i - pos - 1);
+        pos = i;
+    }
+    if (pos < n) {
+        has_fragment = true;
+        fragment_ = url.substr(pos + 1);
+    }
+}
+
+bool UrlView::schemeIs(std::string_view name) const {
+    if (scheme_.size() != name.size()) return false;
+    for (size_t i = 0; i < name.size(); ++i) {
+        char c = scheme_[i];
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+        if (c != name[i]) return false;
+    }
+    return true;
+}
+
+std::string_view UrlView::origin() const {
+    if (!isHttp()) return {};
+    // The authority ends the origin; everything before it is "scheme://"
+    size_t length = static_cast<size_t>(authority_.data() + authority_.size() - url.data());
+    return url.substr(0, length);
+}
+
+std::string_view UrlView::pathAndQuery() const {
+    if (!has_query) return path_;
+    return std::string_view(path_.data(), static_cast<size_t>(query_.data() + query_.size() - path_.data()));
+}
@@ -1,19 +1,31 @@
 #include "utils.h"
-#include <regex>
+#include "url_canonicalizer.h"
+#include "url_view.h"
+#include <unistd.h>
+#include <cctype>
+#include <cerrno>
 #include <filesystem>
 #include <iostream>
 
 std::string Utils::extractBaseDomain(const std::string& url) {
-    std::smatch match;
-    std::regex domain_regex(R"(^(https?:\/\/[^\/]+))");
-    if (std::regex_search(url, match, domain_regex)) {
-        return match[1];
-    }
-    return "";
+    return std::string(UrlView(url).origin());
 }
 
 std::string Utils::createSafeFilename(const std::string& url) {
-    return std::regex_replace(url, std::regex("[:/]+"), "_");
+    // Every run of ':' and '/' becomes a single '_'
+    std::string name;
+    name.reserve(url.size());
+    bool in_run = false;
+    for (char c : url) {
+        bool separator = c == ':' || c == '/';
+        if (!separator) {
+            name += c;
+        } else if (!in_run) {
+            name += '_';
+        }
+        in_run = separator;
+    }
+    return name;
 }
 
 bool Utils::createOutputDirectory(const std::string& dir) {
@@ -26,31 +38,53 @@ bool Utils::createOutputDirectory(const std::string& dir) {
     return true;
 }
 
+bool Utils::writeAll(int fd, const std::string& data) {
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
 std::string Utils::resolveUrl(const std::string& base_url, const std::string& link) {
     if (link.empty()) return "";
-    
-    // Already absolute
-    if (link.find("http://") == 0 || link.find("https://") == 0) {
-        return link;
+    return UrlCanonicalizer::resolve(base_url, link);
+}
+
+bool Utils::headerNameIs(const std::string& line, size_t colon, const char* name) {
+    size_t i = 0;
+    for (; name[i] != '\0'; ++i) {
+        if (i >= colon || std::tolower(static_cast<unsigned char>(line[i])) != name[i]) return false;
     }
-    
-    // Protocol-relative
-    if (link[0] == '/' && link[1] == '/') {
-        size_t pos = base_url.find(":");
-        if (pos != std::string::npos) {
-            return base_url.substr(0, pos) + ":" + link;
+    return i == colon;
+}
+
+bool Utils::globMatch(std::string_view pattern, std::string_view text, bool anchored) {
+    size_t p = 0, s = 0;
+    size_t star = std::string_view::npos, mark = 0;
+    while (s < text.size()) {
+        if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            mark = s;
+        } else if (p == pattern.size() && !anchored) {
+            return true;
+        } else if (p < pattern.size() && pattern[p] == text[s]) {
+            p++;
+            s++;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            s = ++mark;
+        } else {
+            return false;
         }
     }
-    
-    // Absolute path
-    if (link[0] == '/') {
-        return base_url + link;
-    }
-    
-    // Relative path
-    std::string result = base_url;
-    if (result.back() != '/') {
-        result += "/";
-    }
-    return result + link;
-}
\ No newline at end of file
+    while (p < pattern.size() && pattern[p] == '*') p++;
+    return p == pattern.size();
+}
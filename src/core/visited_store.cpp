@@ -0,0 +1,450 @@
+#include "visited_store.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <istream>
+#include <ostream>
+
+namespace {
+
+// Tightening ratio between successive Bloom filters, and growth factor
+constexpr double kBloomTightening = 0.5;
+constexpr size_t kBloomGrowth = 2;
+
+template<typename T>
+void writeValue(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::istream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+void writeWords(std::ostream& out, const std::vector<uint64_t>& words) {
+    writeValue(out, static_cast<uint64_t>(words.size()));
+    out.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint64_t));
+}
+
+bool readWords(std::istream& in, std::vector<uint64_t>& words) {
+    uint64_t size = 0;
+    if (!readValue(in, size)) return false;
+    words.assign(size, 0);
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(words.data()), size * sizeof(uint64_t)));
+}
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+} // namespace
+
+// MurmurHash64A
+uint64_t VisitedStore::fingerprint(const std::string& url) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const size_t len = url.size();
+    uint64_t h = 0x9747b28cULL ^ (len * m);
+
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(url.data());
+    const unsigned char* end = data + (len / 8) * 8;
+    for (; data != end; data += 8) {
+        uint64_t k;
+        std::memcpy(&k, data, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    switch (len & 7) {
+        case 7: h ^= uint64_t(data[6]) << 48; [[fallthrough]];
+        case 6: h ^= uint64_t(data[5]) << 40; [[fallthrough]];
+        case 5: h ^= uint64_t(data[4]) << 32; [[fallthrough]];
+        case 4: h ^= uint64_t(data[3]) << 24; [[fallthrough]];
+        case 3: h ^= uint64_t(data[2]) << 16; [[fallthrough]];
+        case 2: h ^= uint64_t(data[1]) << 8; [[fallthrough]];
+        case 1: h ^= uint64_t(data[0]);
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+std::unique_ptr<VisitedStore> VisitedStore::create(const std::string& mode, double false_positive_rate) {
+    if (mode == "bloom") {
+        return std::make_unique<BloomVisitedStore>(false_positive_rate);
+    }
+    if (mode != "fingerprint") {
+        std::cerr << "Unknown visited store '" << mode << "', using fingerprint" << std::endl;
+    }
+    return std::make_unique<FingerprintVisitedStore>();
+}
+
+// --- FingerprintVisitedStore ---
+
+FingerprintVisitedStore::FingerprintVisitedStore(size_t initial_capacity) {
+    size_t capacity = 16;
+    while (capacity < initial_capacity) capacity <<= 1;
+    slots.assign(capacity, 0);
+}
+
+bool FingerprintVisitedStore::insertFingerprint(uint64_t fp) {
+    size_t mask = slots.size() - 1;
+    for (size_t i = fp & mask;; i = (i + 1) & mask) {
+        if (slots[i] == fp) return false;
+        if (slots[i] == 0) {
+            slots[i] = fp;
+            count++;
+            return true;
+        }
+    }
+}
+
+void FingerprintVisitedStore::grow() {
+    std::vector<uint64_t> old;
+    old.swap(slots);
+    slots.assign(old.size() * 2, 0);
+    count = 0;
+    for (uint64_t fp : old) {
+        if (fp) insertFingerprint(fp);
+    }
+}
+
+bool FingerprintVisitedStore::insert(const std::string& url) {
+    // Keep the load factor under 0.7 so probe sequences stay short
+    if ((count + 1) * 10 > slots.size() * 7) {
+        grow();
+    }
+    return insertFingerprint(nonZero(fingerprint(url)));
+}
+
+bool FingerprintVisitedStore::contains(const std::string& url) const {
+    uint64_t fp = nonZero(fingerprint(url));
+    size_t mask = slots.size() - 1;
+    for (size_t i = fp & mask;; i = (i + 1) & mask) {
+        if (slots[i] == fp) return true;
+        if (slots[i] == 0) return false;
+    }
+}
+
+std::unique_ptr<VisitedStore> FingerprintVisitedStore::clone() const {
+    return std::make_unique<FingerprintVisitedStore>(*this);
+}
+
+bool FingerprintVisitedStore::save(std::ostream& out) const {
+    writeValue(out, static_cast<uint64_t>(count));
+    writeWords(out, slots);
+    return static_cast<bool>(out);
+}
+
+bool FingerprintVisitedStore::load(std::istream& in) {
+    uint64_t stored_count = 0;
+    std::vector<uint64_t> stored_slots;
+    if (!readValue(in, stored_count) || !readWords(in, stored_slots)) return false;
+    // Capacity must stay a power of two for the probe mask
+    if (stored_slots.empty() || (stored_slots.size() & (stored_slots.size() - 1))) return false;
+    slots.swap(stored_slots);
+    count = stored_count;
+    return true;
+}
+
+// --- BloomVisitedStore ---
+
+BloomVisitedStore::BloomVisitedStore(double false_positive_rate, size_t initial_capacity)
+    : false_positive_rate(false_positive_rate), initial_capacity(initial_capacity) {
+    if (this->false_positive_rate <= 0.0 || this->false_positive_rate >= 1.0) {
+        std::cerr << "Invalid Bloom false-positive rate " << false_positive_rate << ", using 0.001" << std::endl;
+        this->false_positive_rate = 0.001;
+    }
+    addFilter();
+}
+
+void BloomVisitedStore::addFilter() {
+    // Filter i gets error rate p0 * r^i with p0 = p * (1 - r), so the sum stays below p
+    size_t index = filters.size();
+    double p = false_positive_rate * (1.0 - kBloomTightening) * std::pow(kBloomTightening, static_cast<double>(index));
+    size_t capacity = filters.empty() ? initial_capacity : filters.back().capacity * kBloomGrowth;
+
+    const double ln2 = std::log(2.0);
+    Filter filter;
+    filter.capacity = capacity;
+    filter.num_bits = static_cast<uint64_t>(std::ceil(-static_cast<double>(capacity) * std::log(p) / (ln2 * ln2)));
+    filter.num_bits = (filter.num_bits + 63) & ~uint64_t(63);
+    filter.num_hashes = std::max(1, static_cast<int>(std::round(std::log2(1.0 / p))));
+    filter.bits.assign(filter.num_bits / 64, 0);
+    filters.push_back(std::move(filter));
+}
+
+bool BloomVisitedStore::filterContains(const Filter& filter, uint64_t h1, uint64_t h2) {
+    for (int i = 0; i < filter.num_hashes; ++i) {
+        uint64_t bit = (h1 + static_cast<uint64_t>(i) * h2) % filter.num_bits;
+        if (!(filter.bits[bit >> 6] & (uint64_t(1) << (bit & 63)))) return false;
+    }
+    return true;
+}
+
+bool BloomVisitedStore::insert(const std::string& url) {
+    uint64_t h1 = fingerprint(url);
+    uint64_t h2 = mix64(h1) | 1;    // Odd step for double hashing
+
+    for (const Filter& filter : filters) {
+        if (filterContains(filter, h1, h2)) return false;
+    }
+
+    if (filters.back().count >= filters.back().capacity) {
+        addFilter();
+    }
+
+    Filter& filter = filters.back();
+    for (int i = 0; i < filter.num_hashes; ++i) {
+        uint64_t bit = (h1 + static_cast<uint64_t>(i) * h2) % filter.num_bits;
+        filter.bits[bit >> 6] |= uint64_t(1) << (bit & 63);
+    }
+    filter.count++;
+    count++;
+    return true;
+}
+
+bool BloomVisitedStore::contains(const std::string& url) const {
+    uint64_t h1 = fingerprint(url);
+    uint64_t h2 = mix64(h1) | 1;
+    for (const Filter& filter : filters) {
+        if (filterContains(filter, h1, h2)) return true;
+    }
+    return false;
+}
+
+size_t BloomVisitedStore::memoryUsage() const {
+    size_t bytes = 0;
+    for (const Filter& filter : filters) {
+        bytes += filter.bits.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+std::unique_ptr<VisitedStore> BloomVisitedStore::clone() const {
+    return std::make_unique<BloomVisitedStore>(*this);
+}
+
+bool BloomVisitedStore::save(std::ostream& out) const {
+    writeValue(out, false_positive_rate);
+    writeValue(out, static_cast<uint64_t>(initial_capacity));
+    writeValue(out, static_cast<uint64_t>(count));
+    writeValue(out, static_cast<uint64_t>(filters.size()));
+    for (const Filter& filter : filters) {
+        writeValue(out, filter.num_bits);
+        writeValue(out, static_cast<int32_t>(filter.num_hashes));
+        writeValue(out, static_cast<uint64_t>(filter.capacity));
+        writeValue(out, static_cast<uint64_t>(filter.count));
+        writeWords(out, filter.bits);
+    }
+    return static_cast<bool>(out);
+}
+
+bool BloomVisitedStore::load(std::istream& in) {
+    double stored_rate = 0;
+    uint64_t stored_initial = 0, stored_count = 0, num_filters = 0;
+    if (!readValue(in, stored_rate) || !readValue(in, stored_initial) ||
+        !readValue(in, stored_count) || !readValue(in, num_filters) || num_filters == 0) {
+        return false;
+    }
+
+    std::vector<Filter> stored_filters(num_filters);
+    for (Filter& filter : stored_filters) {
+        int32_t num_hashes = 0;
+        uint64_t capacity = 0, filter_count = 0;
+        if (!readValue(in, filter.num_bits) || !readValue(in, num_hashes) ||
+            !readValue(in, capacity) || !readValue(in, filter_count) || !readWords(in, filter.bits)) {
+            return false;
+        }
+        if (filter.num_bits == 0 || filter.bits.size() * 64 != filter.num_bits) return false;
+        filter.num_hashes = num_hashes;
+        filter.capacity = capacity;
+        filter.count = filter_count;
+    }
+
+    false_positive_rate = stored_rate;
+    initial_capacity = stored_initial;
+    count = stored_count;
+    filters.swap(stored_filters);
+    return true;
+}
+
+// --- ShardedVisitedStore ---
+
+ShardedVisitedStore::ShardedVisitedStore(const std::string& mode, double false_positive_rate, size_t num_shards)
+    : mode(mode), false_positive_rate(false_positive_rate) {
+    for (size_t i = 0; i < std::max<size_t>(1, num_shards); ++i) {
+        shards.push_back(std::make_unique<Shard>());
+        shards.back()->store = VisitedStore::create(mode, false_positive_rate);
+    }
+    this->mode = shards.front()->store->getName();
+}
+
+ShardedVisitedStore::ShardedVisitedStore(std::vector<std::unique_ptr<VisitedStore>> stores)
+    : false_positive_rate(0.001) {
+    for (auto& store : stores) {
+        shards.push_back(std::make_unique<Shard>());
+        shards.back()->store = std::move(store);
+    }
+    mode = shards.empty() ? "fingerprint" : shards.front()->store->getName();
+    if (shards.empty()) {
+        shards.push_back(std::make_unique<Shard>());
+        shards.back()->store = VisitedStore::create(mode);
+    }
+}
+
+ShardedVisitedStore::ShardedVisitedStore(std::vector<std::unique_ptr<Shard>> shards, const std::string& mode,
+                                         double false_positive_rate)
+    : shards(std::move(shards)), mode(mode), false_positive_rate(false_positive_rate) {}
+
+bool ShardedVisitedStore::shared(const Shard& shard) {
+    if (shard.store.use_count() == 1) {
+        // Pairs with the release of the other owner, whose reads of the store
+        // must be done before it is changed here
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return false;
+    }
+    return true;
+}
+
+void ShardedVisitedStore::mergePending(Shard& shard) {
+    for (const auto& entry : shard.pending) {
+        shard.store->insert(entry.second);
+    }
+    shard.pending.clear();
+    shard.pending.rehash(0);
+}
+
+bool ShardedVisitedStore::insertLocked(Shard& shard, const std::string& url, uint64_t fp) {
+    if (shared(shard)) {
+        if (shard.store->contains(url)) return false;
+        return shard.pending.emplace(fp, url).second;
+    }
+    if (!shard.pending.empty()) mergePending(shard);
+    return shard.store->insert(url);
+}
+
+bool ShardedVisitedStore::containsLocked(const Shard& shard, const std::string& url, uint64_t fp) {
+    return shard.pending.count(fp) > 0 || shard.store->contains(url);
+}
+
+std::shared_ptr<VisitedStore> ShardedVisitedStore::copyLocked(const Shard& shard) {
+    std::shared_ptr<VisitedStore> copy = shard.store->clone();
+    for (const auto& entry : shard.pending) {
+        copy->insert(entry.second);
+    }
+    return copy;
+}
+
+void ShardedVisitedStore::insertBatch(const std::vector<std::string>& urls, std::vector<std::string>& fresh) {
+    // Group by shard first so each lock is taken once per batch
+    std::vector<uint64_t> fingerprints(urls.size());
+    std::vector<std::vector<size_t>> groups(shards.size());
+    for (size_t i = 0; i < urls.size(); ++i) {
+        fingerprints[i] = fingerprint(urls[i]);
+        groups[shardIndex(fingerprints[i])].push_back(i);
+    }
+
+    std::vector<char> is_new(urls.size(), 0);
+    for (size_t s = 0; s < groups.size(); ++s) {
+        if (groups[s].empty()) continue;
+        std::lock_guard<std::mutex> lock(shards[s]->mutex);
+        for (size_t i : groups[s]) {
+            is_new[i] = insertLocked(*shards[s], urls[i], fingerprints[i]);
+        }
+    }
+
+    for (size_t i = 0; i < urls.size(); ++i) {
+        if (is_new[i]) fresh.push_back(urls[i]);
+    }
+}
+
+bool ShardedVisitedStore::insert(const std::string& url) {
+    uint64_t fp = fingerprint(url);
+    Shard& shard = *shards[shardIndex(fp)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return insertLocked(shard, url, fp);
+}
+
+bool ShardedVisitedStore::contains(const std::string& url) const {
+    uint64_t fp = fingerprint(url);
+    const Shard& shard = *shards[shardIndex(fp)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return containsLocked(shard, url, fp);
+}
+
+size_t ShardedVisitedStore::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->store->size() + shard->pending.size();
+    }
+    return total;
+}
+
+size_t ShardedVisitedStore::memoryUsage() const {
+    size_t total = 0;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->store->memoryUsage();
+        // Rough: one node and bucket per pending URL
+        total += shard->pending.size() * (sizeof(std::pair<const uint64_t, std::string>) + 2 * sizeof(void*));
+    }
+    return total;
+}
+
+std::unique_ptr<VisitedStore> ShardedVisitedStore::clone() const {
+    std::vector<std::unique_ptr<Shard>> copies;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        copies.push_back(std::make_unique<Shard>());
+        if (shard->pending.empty()) {
+            copies.back()->store = shard->store;
+        } else if (!shared(*shard)) {
+            // Left from the last copy; bounded by the URLs found while it was saved
+            mergePending(*shard);
+            copies.back()->store = shard->store;
+        } else {
+            // Another copy still holds the store: the rare overlapping copy is a deep one
+            copies.back()->store = copyLocked(*shard);
+        }
+    }
+    return std::unique_ptr<VisitedStore>(new ShardedVisitedStore(std::move(copies), mode, false_positive_rate));
+}
+
+bool ShardedVisitedStore::save(std::ostream& out) const {
+    writeValue(out, static_cast<uint64_t>(shards.size()));
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        bool saved = shard->pending.empty() ? shard->store->save(out) : copyLocked(*shard)->save(out);
+        if (!saved) return false;
+    }
+    return static_cast<bool>(out);
+}
+
+bool ShardedVisitedStore::load(std::istream& in) {
+    uint64_t num_shards = 0;
+    if (!readValue(in, num_shards) || num_shards == 0) return false;
+
+    std::vector<std::unique_ptr<Shard>> stored;
+    for (uint64_t i = 0; i < num_shards; ++i) {
+        stored.push_back(std::make_unique<Shard>());
+        stored.back()->store = VisitedStore::create(mode, false_positive_rate);
+        if (!stored.back()->store->load(in)) return false;
+    }
+    shards.swap(stored);
+    return true;
+}
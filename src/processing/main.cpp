@@ -1,4 +1,6 @@
 #include "crawler.h"
+#include "downloader.h"
+#include "checkpoint.h"
 #include "processing_pipeline.h"
 #include "builtin_processors.h"
 #include <iostream>
@@ -13,6 +15,48 @@ struct CrawlerOptions {
     int max_pages = -1;     // -1 means no limit
     std::string output_dir = "output";
     int concurrent_threads = 5;
+    int max_in_flight = 0;
+    int host_delay_ms = 0;
+    int max_per_host = 0;
+    bool adaptive_concurrency = false;
+    int min_per_host = 1;
+    int max_retries = 3;
+    int retry_delay_ms = 1000;
+    int retry_max_delay_sec = 300;
+    size_t frontier_memory_mb = 0;
+    std::string visited_store = "fingerprint";
+    double bloom_fp_rate = 0.001;
+    int checkpoint_interval_sec = 60;
+    std::string resume_dir;
+    std::string link_parser = "tokenizer";
+    std::string storage_format = "segments";
+    size_t segment_size_mb = 256;
+    size_t write_queue_mb = 64;
+    std::string fsync_policy = "none";
+    int fsync_interval_ms = 1000;
+    std::string compression = "none";
+    size_t dictionary_samples = 0;
+    bool store_duplicates = false;
+    bool incremental = false;
+    bool all_content_types = false;
+    size_t max_page_kb = 10240;
+    std::string url_rules = "drop-tracking,sort-query";
+    std::string drop_params;
+    bool ignore_robots = false;
+    int robots_ttl_sec = 86400;
+    std::vector<std::string> sitemaps;
+    std::string crawl_policy = "bfs";
+    std::string url_weights;
+    double depth_weight = 1.0;
+    double inlink_weight = 1.0;
+    std::string scorer_plugin;
+    std::string target_pattern;
+    bool skip_near_dups = false;
+    int near_dup_bits = 3;
+    size_t near_dup_window = 100000;
+    bool dns_prefetch = false;
+    std::string dns_hosts;
+    int dns_ttl_sec = 300;
 
     // Processing options
     std::string input_dir;  // For processing existing files
@@ -22,6 +66,7 @@ struct CrawlerOptions {
     std::string export_format = "json";
     std::string export_file = "processed_output.json";
     size_t processing_threads = 4;
+    bool changed_only = false;
 
     // Queries for processing
     std::string filter_text;
@@ -69,6 +114,202 @@ CrawlerOptions parseArguments(int argc, char** argv) {
                 options.concurrent_threads = std::atoi(argv[++i]);
             }
         }
+        else if (arg == "--max-in-flight") {
+            if (i + 1 < argc) {
+                options.max_in_flight = std::atoi(argv[++i]);
+            }
+        }
+        else if (arg == "--host-delay") {
+            if (i + 1 < argc) {
+                options.host_delay_ms = std::atoi(argv[++i]);
+            }
+        }
+        else if (arg == "--max-per-host") {
+            if (i + 1 < argc) {
+                options.max_per_host = std::atoi(argv[++i]);
+            }
+        }
+        else if (arg == "--adaptive-concurrency") {
+            options.adaptive_concurrency = true;
+        }
+        else if (arg == "--min-per-host") {
+            if (i + 1 < argc) {
+                options.min_per_host = std::atoi(argv[++i]);
+            }
+        }
+        else if (arg == "--max-retries") {
+            if (i + 1 < argc) {
+                options.max_retries = std::atoi(argv[++i]);
+            }
+        }
+        else if (arg == "--retry-delay") {
+            if (i + 1 < argc) {
+                options.retry_delay_ms = std::atoi(argv[++i]);
+            }
+        }
+        else if (arg == "--retry-max-delay") {
+            if (i + 1 < argc) {
+                options.retry_max_delay_sec = std::atoi(argv[++i]);
+            }
+        }
+        else if (arg == "--frontier-memory") {
+            if (i + 1 < argc) {
+                options.frontier_memory_mb = static_cast<size_t>(std::atoi(argv[++i]));
+            }
+        }
+        else if (arg == "--visited-store") {
+            if (i + 1 < argc) {
+                options.visited_store = argv[++i];
+            }
+        }
+        else if (arg == "--link-parser") {
+            if (i + 1 < argc) {
+                options.link_parser = argv[++i];
+            }
+        }
+        else if (arg == "--storage") {
+            if (i + 1 < argc) {
+                options.storage_format = argv[++i];
+            }
+        }
+        else if (arg == "--segment-size") {
+            if (i + 1 < argc) {
+                options.segment_size_mb = static_cast<size_t>(std::atoi(argv[++i]));
+            }
+        }
+        else if (arg == "--write-queue") {
+            if (i + 1 < argc) {
+                options.write_queue_mb = static_cast<size_t>(std::atoi(argv[++i]));
+            }
+        }
+        else if (arg == "--fsync") {
+            if (i + 1 < argc) {
+                options.fsync_policy = argv[++i];
+            }
+        }
+        else if (arg == "--fsync-interval") {
+            if (i + 1 < argc) {
+                options.fsync_interval_ms = std::atoi(argv[++i]);
+            }
+        }
+        else if (arg == "--compress") {
+            if (i + 1 < argc) {
+                options.compression = argv[++i];
+            }
+        }
+        else if (arg == "--compress-dict") {
+            if (i + 1 < argc) {
+                options.dictionary_samples = static_cast<size_t>(std::atoi(argv[++i]));
+            }
+        }
+        else if (arg == "--store-duplicates") {
+            options.store_duplicates = true;
+        }
+        else if (arg == "--bloom-fp-rate") {
+            if (i + 1 < argc) {
+                options.bloom_fp_rate = std::atof(argv[++i]);
+            }
+        }
+        else if (arg == "--checkpoint-interval") {
+            if (i + 1 < argc) {
+                options.checkpoint_interval_sec = std::atoi(argv[++i]);
+            }
+        }
+        else if (arg == "--resume") {
+            if (i + 1 < argc) {
+                options.resume_dir = argv[++i];
+            }
+        }
+        else if (arg == "--incremental") {
+            options.incremental = true;
+        }
+        else if (arg == "--all-content-types") {
+            options.all_content_types = true;
+        }
+        else if (arg == "--max-page-size") {
+            if (i + 1 < argc) {
+                options.max_page_kb = static_cast<size_t>(std::atoi(argv[++i]));
+            }
+        }
+        else if (arg == "--url-rules") {
+            if (i + 1 < argc) {
+                options.url_rules = argv[++i];
+            }
+        }
+        else if (arg == "--drop-params") {
+            if (i + 1 < argc) {
+                options.drop_params = argv[++i];
+            }
+        }
+        else if (arg == "--ignore-robots") {
+            options.ignore_robots = true;
+        }
+        else if (arg == "--robots-ttl") {
+            if (i + 1 < argc) {
+                options.robots_ttl_sec = std::atoi(argv[++i]);
+            }
+        }
+        else if (arg == "--sitemap") {
+            if (i + 1 < argc) {
+                options.sitemaps.push_back(argv[++i]);
+            }
+        }
+        else if (arg == "--crawl-policy") {
+            if (i + 1 < argc) {
+                options.crawl_policy = argv[++i];
+            }
+        }
+        else if (arg == "--url-weights") {
+            if (i + 1 < argc) {
+                options.url_weights = argv[++i];
+            }
+        }
+        else if (arg == "--depth-weight") {
+            if (i + 1 < argc) {
+                options.depth_weight = std::atof(argv[++i]);
+            }
+        }
+        else if (arg == "--inlink-weight") {
+            if (i + 1 < argc) {
+                options.inlink_weight = std::atof(argv[++i]);
+            }
+        }
+        else if (arg == "--scorer-plugin") {
+            if (i + 1 < argc) {
+                options.scorer_plugin = argv[++i];
+            }
+        }
+        else if (arg == "--target-pattern") {
+            if (i + 1 < argc) {
+                options.target_pattern = argv[++i];
+            }
+        }
+        else if (arg == "--skip-near-dups") {
+            options.skip_near_dups = true;
+        }
+        else if (arg == "--near-dup-bits") {
+            if (i + 1 < argc) {
+                options.near_dup_bits = std::atoi(argv[++i]);
+            }
+        }
+        else if (arg == "--near-dup-window") {
+            if (i + 1 < argc) {
+                options.near_dup_window = std::strtoull(argv[++i], nullptr, 10);
+            }
+        }
+        else if (arg == "--dns-prefetch") {
+            options.dns_prefetch = true;
+        }
+        else if (arg == "--dns-hosts") {
+            if (i + 1 < argc) {
+                options.dns_hosts = argv[++i];
+            }
+        }
+        else if (arg == "--dns-ttl") {
+            if (i + 1 < argc) {
+                options.dns_ttl_sec = std::atoi(argv[++i]);
+            }
+        }
 
         // Processor options
         else if (arg == "--process" || arg == "-p") {
@@ -83,6 +324,9 @@ CrawlerOptions parseArguments(int argc, char** argv) {
                 options.url = argv[++i];
             }
         }
+        else if (arg == "--changed-only") {
+            options.changed_only = true;
+        }
         else if (arg == "--processor-type") {
             if (i + 1 < argc) {
                 options.processor_type = argv[++i];
@@ -157,18 +401,65 @@ void printHelp(const char* program_name) {
     std::cout << "Usage: " << program_name << " [MODE] [OPTIONS]\n";
     std::cout << "\nModes:\n";
     std::cout << "  --url URL, -u URL      Crawl mode - start crawling from URL\n";
+    std::cout << "  --resume DIR           Crawl mode - continue the crawl checkpointed in output directory DIR\n";
     std::cout << "  --process DIR, -p DIR  Process mode - process HTML files in directory\n";
     std::cout << "  --both URL, -b URL     Both mode - crawl then process\n";
     std::cout << "\nCrawler Options:\n";
     std::cout << "  -m, --max-pages N      Maximum number of pages to crawl (default: unlimited)\n";
     std::cout << "  -o, --output DIR       Output directory for crawled files (default: output)\n";
     std::cout << "  -t, --concurrent-threads N  Number of concurrent threads (default: 5)\n";
+    std::cout << "  --max-in-flight N      Use the event-driven engine with up to N transfers in flight;\n";
+    std::cout << "                         -t then sets the size of the parsing pool (default: 0, disabled)\n";
+    std::cout << "  --host-delay MS        Minimum delay between requests to the same host (default: 0)\n";
+    std::cout << "  --max-per-host N       Maximum parallel requests per host (default: 0, unlimited)\n";
+    std::cout << "  --adaptive-concurrency Adjust each host's parallel requests to its latency and 429/5xx rate,\n";
+    std::cout << "                         up to -t, --max-in-flight or --max-per-host; decisions go to <output>/concurrency.csv\n";
+    std::cout << "  --min-per-host N       Lower bound of the adaptive per-host limits (default: 1)\n";
+    std::cout << "  --max-retries N        Fetch a URL up to N more times after a timeout, reset, 429 or 5xx (default: 3, 0 disables)\n";
+    std::cout << "  --retry-delay MS       Backoff before the first retry, doubled for each further one (default: 1000)\n";
+    std::cout << "  --retry-max-delay SEC  Longest backoff; URLs whose Retry-After is longer are given up (default: 300)\n";
+    std::cout << "  --frontier-memory MB   Keep at most MB of queued URLs in memory, spill the rest to disk\n";
+    std::cout << "                         under <output>/.frontier (default: 0, unlimited)\n";
+    std::cout << "  --visited-store MODE   Visited URL set: fingerprint (exact 64-bit hashes) or bloom (default: fingerprint)\n";
+    std::cout << "  --bloom-fp-rate P      False-positive bound for --visited-store bloom (default: 0.001)\n";
+    std::cout << "  --max-page-size KB     Abort responses declared or received larger than KB (default: 10240, 0 for no limit)\n";
+    std::cout << "  --all-content-types    Keep non-HTML responses instead of aborting them after the headers\n";
+    std::cout << "  --url-rules LIST       URL canonicalization rules: drop-tracking, sort-query or none (default: drop-tracking,sort-query)\n";
+    std::cout << "  --drop-params NAMES    Comma-separated query parameters to drop from links, '*' suffix for prefixes\n";
+    std::cout << "  --ignore-robots        Crawl URLs disallowed by robots.txt and ignore its Crawl-delay\n";
+    std::cout << "  --robots-ttl SEC       Seconds a fetched robots.txt is used before it is fetched again (default: 86400)\n";
+    std::cout << "  --sitemap URL          Seed the frontier from a sitemap or sitemap index, 'auto' to look it up (repeatable)\n";
+    std::cout << "  --crawl-policy NAME    Order of the frontier: bfs or best-first (default: bfs)\n";
+    std::cout << "  --url-weights LIST     Best-first score of URL patterns, e.g. '/article/=3,/tag/=-2'\n";
+    std::cout << "  --depth-weight W       Best-first score lost per link from the start URL (default: 1)\n";
+    std::cout << "  --inlink-weight W      Best-first score per doubling of the links to a URL (default: 1)\n";
+    std::cout << "  --scorer-plugin PATH   Shared library whose scoreUrl() is added to best-first scores\n";
+    std::cout << "  --target-pattern PAT   Report the share of crawled pages whose URL matches PAT\n";
+    std::cout << "  --skip-near-dups       Neither store nor follow the links of pages whose text nearly matches a recent page\n";
+    std::cout << "  --near-dup-bits K      SimHash bits two pages may differ in to count as near-duplicates (default: 3)\n";
+    std::cout << "  --near-dup-window N    Recent pages a page is compared against (default: 100000)\n";
+    std::cout << "  --dns-prefetch         Resolve hosts in the background while their URLs wait in the frontier\n";
+    std::cout << "  --dns-hosts FILE       Hosts file whose addresses are used instead of DNS (implies --dns-prefetch)\n";
+    std::cout << "  --dns-ttl SEC          Seconds a prefetched address is used before it is resolved again (default: 300)\n";
+    std::cout << "  --link-parser NAME     Link extraction: tokenizer (single-pass scan) or gumbo (full DOM) (default: tokenizer)\n";
+    std::cout << "  --storage FORMAT       Page storage: segments (WARC segment files) or files (one .html per page) (default: segments)\n";
+    std::cout << "  --segment-size MB      Start a new segment once the current one reaches MB (default: 256)\n";
+    std::cout << "  --write-queue MB       Pages buffered for the storage thread before workers block (default: 64)\n";
+    std::cout << "  --fsync POLICY         Page durability: none, batch (fsync each write batch) or interval (default: none)\n";
+    std::cout << "  --fsync-interval MS    Milliseconds between syncs with --fsync interval (default: 1000)\n";
+    std::cout << "  --compress METHOD      Per-page compression of stored pages: none or zlib (default: none)\n";
+    std::cout << "  --compress-dict N      Train a compression dictionary from the first N pages (default: 0, none)\n";
+    std::cout << "  --store-duplicates     Store every body in full, even if an identical body was stored before\n";
+    std::cout << "  --checkpoint-interval SEC  Seconds between crawl checkpoints in <output>/.checkpoint (default: 60, 0 disables)\n";
+    std::cout << "  --incremental          Recrawl the pages stored in the output directory with conditional requests\n";
+    std::cout << "                         and list new or changed pages in <output>/changed.txt\n";
     std::cout << "\nProcessor Options:\n";
     std::cout << "  --processor-type TYPE  Processor type (generic, text, metadata, links)\n";
     std::cout << "  -q, --query TERM       Search query for filtering\n";
     std::cout << "  -e, --export FORMAT    Export format (json, csv, database)\n";
     std::cout << "  --export-file FILE     Output file name (default: processed_output.json)\n";
     std::cout << "  -pt, --processing-threads N  Number of threads for processing (default: 4)\n";
+    std::cout << "  --changed-only         Only process the pages listed in <dir>/changed.txt by an incremental recrawl\n";
     std::cout << "\nFiltering Options (for processing mode):\n";
     std::cout << "  --filter-text TERM       Filter files containing TERM in title/text\n";
     std::cout << "  --filter-case-sensitive  Make text filter case-sensitive (default: false)\n";
@@ -200,6 +491,15 @@ int main(int argc, char** argv) {
 
     if (options.processor_mode == "crawl" || options.processor_mode == "both") {
 
+        if (!options.resume_dir.empty()) {
+            // The checkpoint knows where the crawl started and where its files go
+            options.output_dir = options.resume_dir;
+            if (!Checkpoint::readStartUrl(options.resume_dir, options.url)) {
+                std::cerr << "Error: No crawl checkpoint found in " << options.resume_dir << "\n";
+                return 1;
+            }
+        }
+
         if (options.url.empty()) {
             std::cerr << "Error: URL is required for crawl mode\n";
             printHelp(argv[0]);
@@ -211,7 +511,21 @@ int main(int argc, char** argv) {
         std::cout << "  URL: " << options.url << "\n";
         std::cout << "  Max pages: " << (options.max_pages == -1 ? "unlimited" : std::to_string(options.max_pages)) << "\n";
         std::cout << "  Output dir: " << options.output_dir << "\n";
+        if (!options.resume_dir.empty()) {
+            std::cout << "  Resuming from checkpoint in: " << options.resume_dir << "\n";
+        }
         std::cout << "  Concurrent threads: " << options.concurrent_threads << "\n";
+        if (options.max_in_flight > 0) {
+            std::cout << "  Max in-flight transfers: " << options.max_in_flight << "\n";
+        }
+        if (options.crawl_policy != "bfs") {
+            std::cout << "  Crawl policy: " << options.crawl_policy << "\n";
+        }
+        if (options.host_delay_ms > 0 || options.max_per_host > 0) {
+            std::cout << "  Per-host politeness: " << options.host_delay_ms << "ms delay, "
+                      << (options.max_per_host > 0 ? std::to_string(options.max_per_host) : "unlimited")
+                      << " parallel\n";
+        }
         
         curl_global_init(CURL_GLOBAL_DEFAULT);
         
@@ -219,10 +533,53 @@ int main(int argc, char** argv) {
         crawl_opts.max_pages = options.max_pages;
         crawl_opts.output_dir = options.output_dir;
         crawl_opts.concurrent_threads = options.concurrent_threads;
+        crawl_opts.max_in_flight = options.max_in_flight;
+        crawl_opts.host_delay_ms = options.host_delay_ms;
+        crawl_opts.max_per_host = options.max_per_host;
+        crawl_opts.adaptive_concurrency = options.adaptive_concurrency;
+        crawl_opts.min_per_host = options.min_per_host;
+        crawl_opts.max_retries = options.max_retries;
+        crawl_opts.retry_delay_ms = options.retry_delay_ms;
+        crawl_opts.retry_max_delay_sec = options.retry_max_delay_sec;
+        crawl_opts.frontier_memory_mb = options.frontier_memory_mb;
+        crawl_opts.visited_store = options.visited_store;
+        crawl_opts.bloom_fp_rate = options.bloom_fp_rate;
+        crawl_opts.link_parser = options.link_parser;
+        crawl_opts.storage_format = options.storage_format;
+        crawl_opts.segment_size_mb = options.segment_size_mb;
+        crawl_opts.write_queue_mb = options.write_queue_mb;
+        crawl_opts.fsync_policy = options.fsync_policy;
+        crawl_opts.fsync_interval_ms = options.fsync_interval_ms;
+        crawl_opts.compression = options.compression;
+        crawl_opts.dictionary_samples = options.dictionary_samples;
+        crawl_opts.store_duplicates = options.store_duplicates;
+        crawl_opts.incremental = options.incremental;
+        crawl_opts.html_only = !options.all_content_types;
+        crawl_opts.max_page_kb = options.max_page_kb;
+        crawl_opts.url_rules = options.url_rules;
+        crawl_opts.drop_params = options.drop_params;
+        crawl_opts.respect_robots = !options.ignore_robots;
+        crawl_opts.robots_ttl_sec = options.robots_ttl_sec;
+        crawl_opts.sitemaps = options.sitemaps;
+        crawl_opts.crawl_policy = options.crawl_policy;
+        crawl_opts.url_weights = options.url_weights;
+        crawl_opts.depth_weight = options.depth_weight;
+        crawl_opts.inlink_weight = options.inlink_weight;
+        crawl_opts.scorer_plugin = options.scorer_plugin;
+        crawl_opts.target_pattern = options.target_pattern;
+        crawl_opts.skip_near_dups = options.skip_near_dups;
+        crawl_opts.near_dup_bits = options.near_dup_bits;
+        crawl_opts.near_dup_window = options.near_dup_window;
+        crawl_opts.dns_prefetch = options.dns_prefetch;
+        crawl_opts.dns_hosts = options.dns_hosts;
+        crawl_opts.dns_ttl_sec = options.dns_ttl_sec;
+        crawl_opts.checkpoint_interval_sec = options.checkpoint_interval_sec;
+        crawl_opts.resume = !options.resume_dir.empty();
         
         WebCrawler crawler(options.url, crawl_opts);
         crawler.crawl();
         
+        Downloader::cleanup();
         curl_global_cleanup();
 
         if (options.processor_mode == "crawl") {
@@ -253,6 +610,9 @@ int main(int argc, char** argv) {
         ProcessingPipeline pipeline(process_dir, "plugins", options.processing_threads);
         pipeline.addProcessor(options.processor_type);
         pipeline.setOutputFormat(options.export_format);
+        if (options.changed_only && !pipeline.setChangedPages(RecrawlCache::changedListPath(process_dir))) {
+            return 1;
+        }
 
         if (options.list_processors) {
             pipeline.listProcessors();
@@ -67,6 +67,25 @@ bool PluginLoader::loadPlugin(const std::string& plugin_path, ProcessorRegistry&
 }
 
 
+ScoreUrlFunction PluginLoader::loadScorer(const std::string& plugin_path) {
+    PluginHandle handle = LoadPlugin(plugin_path.c_str());
+    if (!handle) {
+        std::cerr << "Failed to load scorer plugin " << plugin_path << ": " << GetPluginError() << std::endl;
+        return nullptr;
+    }
+
+    ScoreUrlFunction score_func = (ScoreUrlFunction)GetPluginSymbol(handle, "scoreUrl");
+    if (!score_func) {
+        std::cerr << "Plugin " << plugin_path << " does not export 'scoreUrl' function" << std::endl;
+        ClosePlugin(handle);
+        return nullptr;
+    }
+
+    // The library stays loaded for the rest of the run
+    std::cout << "Loaded URL scorer from " << plugin_path << std::endl;
+    return score_func;
+}
+
 std::vector<std::string> PluginLoader::findPlugins(const std::string& plugins_directory) {
     std::vector<std::string> plugin_paths;
 
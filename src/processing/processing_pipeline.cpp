@@ -11,9 +11,15 @@
 #include <future>
 #include <mutex>
 #include <algorithm>
+#include <deque>
+#include <functional>
+#include "recrawl_cache.h"
+#include "content_index.h"
+#include "utils.h"
 
 ProcessingPipeline::ProcessingPipeline(const std::string& input_dir, const std::string& plugins_dir, size_t threads) 
-    : input_directory(input_dir), output_format("json"), plugins_directory(plugins_dir), num_threads(threads) {
+    : input_directory(input_dir), output_format("json"), plugins_directory(plugins_dir), num_threads(threads),
+      codec(std::make_unique<PageCodec>(input_dir)) {
     // Register built-in processors
     registry.registerProcessor("generic", std::make_unique<GenericProcessor>());
     registry.registerProcessor("text", std::make_unique<TextProcessor>());
@@ -40,6 +46,17 @@ void ProcessingPipeline::setOutputFormat(const std::string& format) {
     output_format = format;
 }
 
+bool ProcessingPipeline::setChangedPages(const std::string& list_path) {
+    changed_pages.clear();
+    if (!RecrawlCache::readChangedList(list_path, changed_pages)) {
+        std::cerr << "Could not read changed-pages list: " << list_path << std::endl;
+        return false;
+    }
+    changed_only = true;
+    std::cout << "Processing only the " << changed_pages.size() << " pages listed in " << list_path << std::endl;
+    return true;
+}
+
 std::vector<ProcessedData> ProcessingPipeline::processAllFiles() {
     std::vector<ProcessedData> results;
     
@@ -48,58 +65,252 @@ std::vector<ProcessedData> ProcessingPipeline::processAllFiles() {
         return results;
     }
     
-    // Collect all html files first
-    std::vector<std::filesystem::directory_entry> html_files;
+    // Collect all html files and page segments first
+    std::vector<std::filesystem::directory_entry> candidates;
     for (const auto& entry : std::filesystem::directory_iterator(input_directory)) {
-        if (entry.path().extension() == ".html") {
-            html_files.push_back(entry);
+        bool compressed = entry.path().extension() == ".z" && entry.path().stem().extension() == ".html";
+        if (entry.path().extension() == ".html" || compressed) candidates.push_back(entry);
+    }
+    std::vector<std::string> segment_files = SegmentReader::listSegments(input_directory);
+
+    // The content map names the URL behind each file and groups the URLs
+    // sharing one body, which was stored in a single file
+    struct SharedBody {
+        std::vector<std::string> urls;
+        std::filesystem::directory_entry file;
+        bool has_file = false;
+    };
+    std::unordered_map<std::string, SharedBody> shared;         // Digest -> URLs with that body
+    std::unordered_map<std::string, std::string> file_urls;     // File name -> URL
+    std::unordered_map<std::string, std::string> url_digests;
+    if (!candidates.empty() && ContentIndex::readMap(ContentIndex::mapPath(input_directory), url_digests)) {
+        for (const auto& entry : url_digests) {
+            file_urls.emplace(Utils::createSafeFilename(entry.first) + ".html", entry.first);
+            if (!changed_only || changed_pages.count(entry.first)) shared[entry.second].urls.push_back(entry.first);
         }
     }
 
-    if (html_files.empty()) {
-        std::cout << "No html files found in directory: " << input_directory << std::endl;
+    std::unordered_set<std::string> changed_files;
+    for (const auto& url : changed_pages) {
+        changed_files.insert(Utils::createSafeFilename(url) + ".html");
+    }
+    std::vector<std::filesystem::directory_entry> html_files;
+    std::vector<const SharedBody*> shared_files;
+    for (const auto& entry : candidates) {
+        bool compressed = entry.path().extension() == ".z";
+        std::string name = (compressed ? entry.path().stem() : entry.path().filename()).string();
+        auto mapped = file_urls.find(name);
+        if (mapped != file_urls.end()) {
+            // Processed once for every wanted URL with its body
+            auto body = shared.find(url_digests[mapped->second]);
+            if (body != shared.end() && !body->second.has_file) {
+                body->second.file = entry;
+                body->second.has_file = true;
+                shared_files.push_back(&body->second);
+            }
+            continue;
+        }
+        if (changed_only && !changed_files.count(name)) continue;
+        html_files.push_back(entry);
+    }
+
+    // A page changed by a recrawl also has older copies in earlier segments.
+    // Newest segments go first so only the latest copy is processed, and the
+    // offset index lets unlisted records be skipped without reading them.
+    // Revisit records hold no body; they are resolved once every stored
+    // body has been processed.
+    std::unordered_set<std::string> done;
+    std::vector<PageRecord> revisits;
+    if (changed_only) std::reverse(segment_files.begin(), segment_files.end());
+    auto readSegment = [&](const std::string& segment, const std::function<void(PageRecord&&)>& consume) {
+        SegmentReader reader(segment, codec.get());
+        PageRecord record;
+        auto take = [&]() {
+            if (record.refers_to.empty()) {
+                consume(std::move(record));
+            } else {
+                revisits.push_back(std::move(record));
+            }
+        };
+        std::vector<SegmentReader::IndexEntry> index;
+        if (changed_only && SegmentReader::readIndex(segment, index)) {
+            for (const auto& entry : index) {
+                if (!changed_pages.count(entry.url) || !done.insert(entry.url).second) continue;
+                if (reader.readAt(entry.offset, record)) take();
+            }
+            return;
+        }
+        while (reader.next(record)) {
+            if (changed_only && (!changed_pages.count(record.url) || !done.insert(record.url).second)) continue;
+            take();
+        }
+    };
+
+    if (html_files.empty() && shared_files.empty() && segment_files.empty()) {
+        std::cout << "No html files or page segments found in directory: " << input_directory << std::endl;
         return results;
     }
 
-    std::cout << "Found " << html_files.size() << " HTML files to process." << std::endl;
+    std::cout << "Found " << html_files.size() + shared_files.size() << " HTML files and " << segment_files.size()
+              << " page segments to process." << std::endl;
+
+    // Results by body digest, for the revisit records sharing them
+    std::unordered_map<std::string, size_t> digest_results;
+    uint64_t reused = 0;
+    auto accept = [&](std::unique_ptr<ProcessedData> result, const std::string& digest,
+                      const std::vector<std::string>* urls) {
+        if (!result) return;
+        if (!digest.empty()) digest_results.emplace(digest, results.size());
+        if (!urls) {
+            results.push_back(std::move(*result));
+            return;
+        }
+        for (size_t i = 0; i < urls->size(); ++i) {
+            if (i + 1 < urls->size()) {
+                results.push_back(*result);
+            } else {
+                results.push_back(std::move(*result));
+            }
+            results.back().url = (*urls)[i];
+        }
+        reused += urls->size() - 1;
+    };
 
     if (thread_pool && num_threads > 0) {
         // --- Concurrent Processing ---
         std::cout << "Processing files concurrently using " << num_threads << " threads..." << std::endl;
-        std::vector<std::future<std::unique_ptr<ProcessedData>>> futures;
+        struct Task {
+            std::future<std::unique_ptr<ProcessedData>> result;
+            std::string digest;
+            const std::vector<std::string>* urls;   // Pages sharing the body, if known
+        };
+        std::deque<Task> futures;
+
+        // Collect the results in submission order
+        auto collect = [&](size_t keep_pending) {
+            while (futures.size() > keep_pending) {
+                try {
+                    auto result = futures.front().result.get(); // This will block until the task is done
+                    accept(std::move(result), futures.front().digest, futures.front().urls);
+                } catch (const std::exception& e) {
+                    std::cerr << "Exception occured during file processing: " << e.what() << std::endl;
+                }
+                futures.pop_front();
+            }
+        };
 
         // Submit all tasks to the thread pool
         for (const auto& entry : html_files) {
-            futures.push_back(
+            futures.push_back(Task{
                 thread_pool->enqueue([this, entry]() { // Pass 'this' to access member functions
                     return this->processSingleFile(entry);
-                })
-            );
+                }),
+                "", nullptr
+            });
+        }
+        for (const SharedBody* body : shared_files) {
+            std::filesystem::directory_entry entry = body->file;
+            futures.push_back(Task{
+                thread_pool->enqueue([this, entry]() {
+                    return this->processSingleFile(entry);
+                }),
+                "", &body->urls
+            });
         }
 
-        // Collect the results as futures complete
-        results.reserve(html_files.size());
-        for (auto& future : futures) {
-            try {
-                auto result = future.get(); // This will block until the task is done
-                if (result) {
-                    results.push_back(std::move(*result));
-                }
-            } catch (const std::exception& e) {
-                std::cerr << "Exception occured during file processing: " << e.what() << std::endl;
-            }
+        // Segments are read sequentially; only a window of records is held in memory
+        const size_t max_pending = num_threads * 64;
+        for (const auto& segment : segment_files) {
+            readSegment(segment, [&](PageRecord&& record) {
+                std::string digest = record.digest;
+                auto shared_record = std::make_shared<PageRecord>(std::move(record));
+                futures.push_back(Task{
+                    thread_pool->enqueue([this, shared_record]() {
+                        return this->processRecord(*shared_record);
+                    }),
+                    std::move(digest), nullptr
+                });
+                collect(max_pending);
+            });
         }
+        collect(0);
     } else {
         // --- Synchronous Processing (Fallback) ---
         std::cout << "Processing files synchronously..." << std::endl;
         results.reserve(html_files.size());
 
         for (const auto& entry : html_files) {
-            auto result = processSingleFile(entry);
-            if (result) {
-                results.push_back(std::move(*result));
+            accept(processSingleFile(entry), "", nullptr);
+        }
+        for (const SharedBody* body : shared_files) {
+            accept(processSingleFile(body->file), "", &body->urls);
+        }
+        for (const auto& segment : segment_files) {
+            readSegment(segment, [&](PageRecord&& record) {
+                accept(processRecord(record), record.digest, nullptr);
+            });
+        }
+    }
+
+    // A revisit takes the result of the stored copy it refers to. When this
+    // pass did not process that copy (--changed-only skips unchanged pages),
+    // it is found through the segment indexes and processed once.
+    std::unordered_map<std::string, std::vector<std::pair<size_t, uint64_t>>> locations;    // URL -> segment, offset
+    std::unordered_map<std::string, std::unique_ptr<ProcessedData>> stored_copies;
+    for (const PageRecord& revisit : revisits) {
+        const ProcessedData* source = nullptr;
+        auto found = revisit.digest.empty() ? digest_results.end() : digest_results.find(revisit.digest);
+        if (found != digest_results.end()) {
+            source = &results[found->second];
+        } else {
+            std::string key = revisit.digest.empty() ? revisit.refers_to + " " + revisit.refers_to_date : revisit.digest;
+            auto copy = stored_copies.find(key);
+            if (copy == stored_copies.end()) {
+                if (locations.empty()) {
+                    for (size_t i = 0; i < segment_files.size(); ++i) {
+                        std::vector<SegmentReader::IndexEntry> index;
+                        SegmentReader::readIndex(segment_files[i], index);
+                        for (auto& entry : index) locations[std::move(entry.url)].emplace_back(i, entry.offset);
+                    }
+                }
+                std::unique_ptr<ProcessedData> result;
+                for (const auto& location : locations[revisit.refers_to]) {
+                    SegmentReader reader(segment_files[location.first], codec.get());
+                    PageRecord record;
+                    if (!reader.readAt(location.second, record) || !record.refers_to.empty()) continue;
+                    bool same = revisit.digest.empty() ? record.fetch_time == revisit.refers_to_date
+                                                       : record.digest == revisit.digest;
+                    if (same) {
+                        result = processRecord(record);
+                        break;
+                    }
+                }
+                if (!result) {
+                    std::cerr << "Stored copy of " << revisit.url << " (" << revisit.refers_to
+                              << ") not found" << std::endl;
+                }
+                copy = stored_copies.emplace(key, std::move(result)).first;
             }
+            source = copy->second.get();
         }
+        if (!source) continue;
+        ProcessedData data = *source;
+        data.url = revisit.url;
+        results.push_back(std::move(data));
+        reused++;
+    }
+    if (reused > 0) {
+        std::cout << "Shared bodies: " << reused << " pages reused the result of an identical body" << std::endl;
+    }
+
+    PageCodec::Stats decode = codec->getStats();
+    if (decode.pages > 0 || decode.failures > 0) {
+        std::cout << "Decompressed " << decode.pages << " pages: " << decode.encoded_bytes / 1024 << " KB stored, "
+                  << decode.decoded_bytes / 1024 << " KB decoded ("
+                  << (decode.decoded_bytes - std::min(decode.decoded_bytes, decode.encoded_bytes)) / 1024
+                  << " KB saved on disk) in " << decode.decode_us / 1000 << " ms of decompression";
+        if (decode.failures > 0) std::cout << ", " << decode.failures << " failed";
+        std::cout << std::endl;
     }
     
     return results;
@@ -535,7 +746,8 @@ bool ProcessingPipeline::exportToDatabase(const std::vector<ProcessedData>& data
 }
 
 std::unique_ptr<ProcessedData> ProcessingPipeline::processSingleFile(const std::filesystem::directory_entry& entry) {
-    if (entry.path().extension() != ".html") {
+    bool compressed = entry.path().extension() == ".z" && entry.path().stem().extension() == ".html";
+    if (entry.path().extension() != ".html" && !compressed) {
         return nullptr; // Skip non html files
     }
 
@@ -548,6 +760,24 @@ std::unique_ptr<ProcessedData> ProcessingPipeline::processSingleFile(const std::
     std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
     file.close();
 
+    if (compressed) {
+        std::string decoded;
+        if (!codec->decompress(content, decoded)) {
+            std::cerr << "Failed to decompress " << entry.path() << std::endl;
+            return nullptr;
+        }
+        content = std::move(decoded);
+    }
+
+    // Extract URL from filename (this is a simplification)
+    return processContent("file://" + entry.path().string(), content);
+}
+
+std::unique_ptr<ProcessedData> ProcessingPipeline::processRecord(const PageRecord& record) {
+    return processContent(record.url, record.body);
+}
+
+std::unique_ptr<ProcessedData> ProcessingPipeline::processContent(const std::string& url, const std::string& content) {
     // Use the first processor in the chain (or generic if none specified)
     std::string processor_name = processor_chain.empty() ? "generic" : processor_chain[0];
     ContentProcessor* processor = registry.getProcessor(processor_name);
@@ -560,8 +790,6 @@ std::unique_ptr<ProcessedData> ProcessingPipeline::processSingleFile(const std::
             processor->setConfig(config_it->second);
         }
 
-        // Extract URL from filename (this is a simplification)
-        std::string url = "file://" + entry.path().string();
         ProcessedData data = processor->process(url, content);
         return std::make_unique<ProcessedData>(std::move(data));
     } else {